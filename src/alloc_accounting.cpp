@@ -0,0 +1,65 @@
+/**
+ * @file alloc_accounting.cpp
+ * @brief The replacements of the global operator new and delete counting every allocation (see AllocationProfile).
+ *
+ * Linked only into the executables built with ALLOCATION_ACCOUNTING. The replacements live in a translation unit
+ * of their own, so that the compiler never sees the std::free of a replaced operator delete next to the
+ * operator new of the caller and warns about a mismatch.
+ */
+
+#include <new>
+#include <cstdlib>
+#include "alloc_accounting.hpp"
+
+#ifdef ALLOCATION_ACCOUNTING
+
+void* operator new(size_t size)
+{
+    AllocationProfile::record(size);
+    if (void* memory = std::malloc(size == 0 ? 1 : size))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    AllocationProfile::record(size);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    AllocationProfile::record(size);
+    size_t align = static_cast<size_t>(alignment);
+    if (void* memory = std::aligned_alloc(align, (size + align - 1) / align * align))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept { std::free(memory); }
+
+#endif
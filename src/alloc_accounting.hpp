@@ -0,0 +1,224 @@
+/**
+ * @file alloc_accounting.hpp
+ * @brief Counting heap allocations by phase and by call site, compiled in only with ALLOCATION_ACCOUNTING defined.
+ */
+
+#ifndef _ALLOC_ACCOUNTING_HPP
+#define _ALLOC_ACCOUNTING_HPP
+
+#include <array>
+#include <cstddef>
+
+/**
+ * @enum AllocationSite
+ * @brief The call sites allocations are attributed to. Anything outside of them counts as OtherSite.
+ */
+enum AllocationSite
+{
+    OtherSite,
+    TokenConstruction,  // the copies of token payloads kept by nodes
+    ConsumedGrowth,  // Context::consumed copying into its owned buffer
+    NodeCreation,  // the blocks of a NodeArena and its list of nodes to destroy
+    ReturnStack,  // the std::stack of ReturnStateStack
+    OutputBuffer,  // the buffer of an OutputSink
+    AllocationSiteCount
+};
+
+constexpr std::array<const char*, AllocationSiteCount> allocation_site_names = {
+    "other", "token", "consumed", "node", "return_stack", "output_buffer"
+};
+
+#ifdef ALLOCATION_ACCOUNTING
+
+#include <atomic>
+#include <string>
+#include <ostream>
+#include <fstream>
+#include <iomanip>
+
+/**
+ * @class AllocationProfile
+ * @brief Counts every call of the global operator new of the process, and the bytes requested, by the
+ * phase of the conversion (see Phase, set by Stats) and the AllocationSite of the calling thread.
+ *
+ * Call sites mark themselves with ALLOCATION_SITE, phases are only told apart where a Stats object is
+ * collecting. All of this exists only in builds with ALLOCATION_ACCOUNTING defined
+ * (cmake -DALLOCATION_ACCOUNTING=ON, always on for alloc_bench), which link alloc_accounting.cpp replacing the
+ * global operator new and delete. Other builds are not slowed down at all.
+ */
+class AllocationProfile
+{
+public:
+    static constexpr size_t PHASES = 8;  // at least PhaseCount, checked in stats.hpp
+
+    struct Counts
+    {
+        size_t allocations = 0;
+        size_t bytes = 0;
+    };
+
+    /**
+     * @brief Counts an allocation of the calling thread. Must not allocate.
+     */
+    static void record(size_t bytes)
+    {
+        Cell& cell = cells[phase][site];
+        cell.allocations.fetch_add(1, std::memory_order_relaxed);
+        cell.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    static void set_phase(size_t phase)
+    {
+        AllocationProfile::phase = phase;
+    }
+
+    static Counts get(size_t phase, AllocationSite site)
+    {
+        const Cell& cell = cells[phase][site];
+        return {cell.allocations.load(std::memory_order_relaxed), cell.bytes.load(std::memory_order_relaxed)};
+    }
+
+    /**
+     * @brief Returns the counts of all phases and sites together.
+     */
+    static Counts total()
+    {
+        Counts sum;
+        for (size_t i = 0; i < PHASES; ++i)
+        {
+            for (size_t j = 0; j < AllocationSiteCount; ++j)
+            {
+                Counts counts = get(i, static_cast<AllocationSite>(j));
+                sum.allocations += counts.allocations;
+                sum.bytes += counts.bytes;
+            }
+        }
+        return sum;
+    }
+
+    static void reset()
+    {
+        for (auto& row : cells)
+        {
+            for (Cell& cell : row)
+            {
+                cell.allocations.store(0, std::memory_order_relaxed);
+                cell.bytes.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Writes the report: allocations and bytes per phase and site, and per KB of input.
+     * @param phase_names The names of the phases, in the order of the Phase enum.
+     * @param input_bytes The size of the input converted while counting.
+     */
+    template <size_t N>
+    static void write_report(std::ostream& out, const std::array<const char*, N>& phase_names, size_t input_bytes)
+    {
+        static_assert(N <= PHASES, "more phases than AllocationProfile counts");
+        double kilobytes = input_bytes / 1024.0;
+        Counts sum = total();
+        out << "Allocation profile: " << sum.allocations << " allocations, " << sum.bytes << " bytes for "
+            << input_bytes << " bytes of input, " << std::fixed << std::setprecision(2)
+            << per_kb(sum.allocations, kilobytes) << " allocations/KB, " << per_kb(sum.bytes, kilobytes)
+            << " bytes/KB\n\n";
+        out << std::left << std::setw(16) << "phase" << std::setw(16) << "site" << std::right << std::setw(14)
+            << "allocations" << std::setw(16) << "bytes" << std::setw(14) << "allocs/KB" << std::setw(14) << "bytes/KB\n";
+        for (size_t i = 0; i < N; ++i)
+        {
+            for (size_t j = 0; j < AllocationSiteCount; ++j)
+            {
+                Counts counts = get(i, static_cast<AllocationSite>(j));
+                if (counts.allocations == 0)
+                    continue;
+                out << std::left << std::setw(16) << phase_names[i] << std::setw(16) << allocation_site_names[j]
+                    << std::right << std::setw(14) << counts.allocations << std::setw(16) << counts.bytes
+                    << std::setw(14) << per_kb(counts.allocations, kilobytes)
+                    << std::setw(13) << per_kb(counts.bytes, kilobytes) << '\n';
+            }
+        }
+
+        out << "\nBy site\n";
+        for (size_t j = 0; j < AllocationSiteCount; ++j)
+        {
+            Counts site_sum;
+            for (size_t i = 0; i < N; ++i)
+            {
+                Counts counts = get(i, static_cast<AllocationSite>(j));
+                site_sum.allocations += counts.allocations;
+                site_sum.bytes += counts.bytes;
+            }
+            out << std::left << std::setw(32) << allocation_site_names[j] << std::right << std::setw(14)
+                << site_sum.allocations << std::setw(16) << site_sum.bytes
+                << std::setw(14) << per_kb(site_sum.allocations, kilobytes)
+                << std::setw(13) << per_kb(site_sum.bytes, kilobytes) << '\n';
+        }
+        out << std::defaultfloat;
+    }
+
+    /**
+     * @brief Writes the report to a file.
+     * @return Whether the file could be written.
+     */
+    template <size_t N>
+    static bool write_report(const std::string& path, const std::array<const char*, N>& phase_names, size_t input_bytes)
+    {
+        std::ofstream out(path);
+        write_report(out, phase_names, input_bytes);
+        return !out.fail();
+    }
+
+    static double per_kb(size_t count, double kilobytes)
+    {
+        return kilobytes == 0 ? 0 : count / kilobytes;
+    }
+
+private:
+    friend class AllocationSiteScope;
+
+    struct Cell
+    {
+        std::atomic<size_t> allocations;
+        std::atomic<size_t> bytes;
+    };
+
+    static inline Cell cells[PHASES][AllocationSiteCount] = {};  // zero-initialized before any allocation
+    static inline thread_local size_t phase = 0;
+    static inline thread_local AllocationSite site = OtherSite;
+};
+
+/**
+ * @class AllocationSiteScope
+ * @brief Attributes the allocations of the calling thread to a site for as long as it lives.
+ */
+class AllocationSiteScope
+{
+public:
+    AllocationSiteScope(AllocationSite site)
+    : previous(AllocationProfile::site)
+    {
+        AllocationProfile::site = site;
+    }
+
+    AllocationSiteScope(const AllocationSiteScope&) = delete;
+    AllocationSiteScope& operator=(const AllocationSiteScope&) = delete;
+
+    ~AllocationSiteScope()
+    {
+        AllocationProfile::site = previous;
+    }
+
+private:
+    AllocationSite previous;
+};
+
+#define ALLOCATION_SITE(site) AllocationSiteScope allocation_site_scope(site)
+
+#else
+
+#define ALLOCATION_SITE(site) ((void)0)
+
+#endif
+
+#endif
@@ -5,6 +5,12 @@
 #include <sstream>
 #include <optional>
 #include <vector>
+#include <iostream>
+#include <thread>
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include "work_scheduler.hpp"
 
 struct Arguments {
     std::string input_file;
@@ -12,6 +18,17 @@ struct Arguments {
     std::string styles_file;
     bool print_tree;
     size_t log_verbosity = 0;
+    size_t threads = 1;
+    bool stream = false;
+    bool fused = false;
+    bool pipeline = false;
+    bool stats = false;
+    std::string batch_source;
+    std::string serve_socket;
+    std::string cache_dir;
+    size_t cache_size = 1024;  // in MiB
+    std::string write_tree;
+    std::string read_tree;
 };
 
 enum Arg_Types 
@@ -19,7 +36,14 @@ enum Arg_Types
     InputFile,
     OutputFile,
     StylesFile,
-    Logging
+    Logging,
+    Threads,
+    Batch,
+    Serve,
+    Cache,
+    CacheSize,
+    WriteTree,
+    ReadTree
 };
 
 class ArgumentParser 
@@ -31,9 +55,21 @@ public:
      * -o (the path to the output HTML file made by the program)
      * -s (the path to the styles.css file created)
      * -v (the verbosity of logging, 1 for Errors only, 2 adds Warnings, 3 adds Info)
+     * --threads (the number of threads parsing the document, 0 for one per core, at most MAX_THREADS_PER_CORE per core)
+     * --stream (a flag without a value: write each block as soon as it is parsed)
+     * --fused (a flag without a value: write the HTML straight from the parser's tokens, without a tree)
+     * --pipeline (a flag without a value: like --fused, but reading, parsing and rendering run on three threads)
+     * --stats (a flag without a value: print timing and counts as JSON at the end)
+     * --batch (a directory or a manifest of markdown files to convert at once, -o is then the output directory)
+     * --serve (the path of a Unix domain socket to serve conversions on until interrupted, see ConversionServer)
+     * --cache (a directory keeping rendered documents for --batch and --serve, see RenderCache)
+     * --cache-size (the size the cache directory is kept under, in MiB, 1024 by default)
+     * --write-tree (the path of a file to save the parsing tree into, see FlatTreeFile)
+     * --read-tree (the path of a saved parsing tree to render instead of parsing -i)
      * 
      * Arguments can be written separately from their value: -i *input-file*
-     * or together: -i*input-file*
+     * or together: -i*input-file*. Long arguments (starting with --) have to be
+     * written separately from their value: --threads 4
      * 
      * If an argument is passed multiple types, only the last one counts.
     */
@@ -47,7 +83,8 @@ public:
         {
             if (arg_set)
             {
-                set_parsed_arg(&parsed, next_arg, last_type);
+                if (!set_parsed_arg(&parsed, next_arg, last_type))
+                    return std::nullopt;
                 arg_set = false;
                 continue;
             }
@@ -57,6 +94,18 @@ public:
 
             if (next_arg[0] != '-')
                 return std::nullopt;
+
+            if (next_arg[1] == '-')
+            {
+                if (set_long_flag(&parsed, next_arg.substr(2)))
+                    continue;
+                std::optional<Arg_Types> long_type = parse_long_argument(next_arg.substr(2));
+                if (!long_type.has_value())
+                    return std::nullopt;
+                last_type = *long_type;
+                arg_set = true;
+                continue;
+            }
             
             switch (next_arg[1])
             {
@@ -83,10 +132,18 @@ public:
             }
 
             std::string val = next_arg.substr(2);
-            set_parsed_arg(&parsed, val, last_type);
+            if (!set_parsed_arg(&parsed, val, last_type))
+                return std::nullopt;
             arg_set = false;
         }
         
+        if (!parsed.serve_socket.empty())
+            return std::optional<Arguments>{parsed};  // the files are named by the requests
+        if (parsed.output_file.empty() && !parsed.batch_source.empty())
+        {
+            std::cout << "Output directory not specified. Defaulting to output" << std::endl;
+            parsed.output_file = "output";
+        }
         if (parsed.output_file.empty())
         {
             std::cout << "Output file not specified. Defaulting to output.html" << std::endl;
@@ -100,7 +157,79 @@ public:
         return std::optional<Arguments>{parsed};
     }
 private:
-    static void set_parsed_arg(Arguments* parsed, const std::string& val, const Arg_Types& type)
+    static std::optional<Arg_Types> parse_long_argument(const std::string& name)
+    {
+        if (name == "threads")
+            return Threads;
+        if (name == "batch")
+            return Batch;
+        if (name == "serve")
+            return Serve;
+        if (name == "cache")
+            return Cache;
+        if (name == "cache-size")
+            return CacheSize;
+        if (name == "write-tree")
+            return WriteTree;
+        if (name == "read-tree")
+            return ReadTree;
+        return std::nullopt;
+    }
+
+    /**
+     * @brief Sets a long argument which takes no value.
+     * @return Whether `name` is such an argument.
+     */
+    static bool set_long_flag(Arguments* parsed, const std::string& name)
+    {
+        if (name == "stream")
+        {
+            (*parsed).stream = true;
+            return true;
+        }
+        if (name == "fused")
+        {
+            (*parsed).fused = true;
+            return true;
+        }
+        if (name == "pipeline")
+        {
+            (*parsed).pipeline = true;
+            return true;
+        }
+        if (name == "stats")
+        {
+            (*parsed).stats = true;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Sets the value of an argument.
+     * @return Whether the value is acceptable. Numbers have to be written out in full.
+     */
+    /**
+     * @brief Parses a non-negative decimal number taking up the whole of `val`.
+     * @return Whether `val` is such a number, small enough for a size_t.
+     */
+    static bool parse_number(const std::string& val, size_t* number)
+    {
+        if (val.empty() || !std::isdigit(static_cast<unsigned char>(val[0])))
+            return false;  // std::stoul would accept leading spaces and wrap negative numbers around
+        try {
+            size_t end = 0;
+            unsigned long parsed = std::stoul(val, &end);
+            if (end != val.size())
+                return false;
+            *number = parsed;
+        } catch (std::logic_error& err) {  // std::invalid_argument or std::out_of_range
+            return false;
+        }
+        return true;
+    }
+
+    static bool set_parsed_arg(Arguments* parsed, const std::string& val, const Arg_Types& type)
     {
         switch (type)
         {
@@ -114,13 +243,37 @@ private:
                 (*parsed).styles_file = val;
                 break;
             case Logging:
-                try {
-                (*parsed).log_verbosity = std::stoul(val);
-                } catch (std::invalid_argument& err) {
-                    // ignore
-                }
+                if (!parse_number(val, &(*parsed).log_verbosity))
+                    return false;
+                break;
+            case Threads:
+                if (!parse_number(val, &(*parsed).threads))
+                    return false;
+                if ((*parsed).threads == 0)
+                    (*parsed).threads = std::max(1u, std::thread::hardware_concurrency());
+                (*parsed).threads = std::min((*parsed).threads, max_worker_threads());
+                break;
+            case Batch:
+                (*parsed).batch_source = val;
+                break;
+            case Serve:
+                (*parsed).serve_socket = val;
+                break;
+            case Cache:
+                (*parsed).cache_dir = val;
+                break;
+            case CacheSize:
+                if (!parse_number(val, &(*parsed).cache_size))
+                    return false;
+                break;
+            case WriteTree:
+                (*parsed).write_tree = val;
+                break;
+            case ReadTree:
+                (*parsed).read_tree = val;
                 break;
         }
+        return true;
     }
 };
 
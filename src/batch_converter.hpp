@@ -0,0 +1,474 @@
+/**
+ * @file batch_converter.hpp
+ * @brief Converting many documents in one process.
+ */
+
+#ifndef _BATCH_CONVERTER_HPP
+#define _BATCH_CONVERTER_HPP
+
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+#include "error_handler.hpp"
+#include "node_arena.hpp"
+#include "work_scheduler.hpp"
+#include "stats.hpp"
+#include "render_cache.hpp"
+#include "./parsing/input_source.hpp"
+#include "./parsing/markdown_parser.hpp"
+#include "./parsing/parallel_parser.hpp"
+#include "./building/html_constructor.hpp"
+#include "./building/css_constructor.hpp"
+#include "./building/output_sink.hpp"
+
+namespace fs = std::filesystem;
+
+/**
+ * @struct BatchJob
+ * @brief A single document of a batch: where to read it from and where to write its HTML to.
+ */
+struct BatchJob
+{
+    fs::path input;
+    fs::path output;
+    std::string stylesheet_link;  // the path of the shared stylesheet relative to the output
+    uintmax_t size;  // the size of the input, 0 if unknown
+};
+
+/**
+ * @class BatchConverter
+ * @brief Converts a whole set of documents in one process on a work-stealing pool of worker threads.
+ *
+ * The documents are given either as a directory, which is searched recursively for `.md` files, or as
+ * a manifest file listing one document per line. The HTML files are written to an output directory
+ * mirroring the layout of the inputs, all of them linking one stylesheet which holds the union of
+ * the CSS classes used by the documents.
+ *
+ * Every worker has its own `Md_Parser`, `HTML_Builder` and recording `Logger` per document, and its own
+ * `NodeArena` reused for all of its documents. The messages of a document are logged together once it
+ * is converted, each prefixed with the document's path.
+ *
+ * The documents are dealt out to the workers' queues largest first (see WorkScheduler), so that a few
+ * huge documents do not end up last. A document of at least twice PARALLEL_MIN_SEGMENT_SIZE is split
+ * by a `ParallelParser` whose segments are spawned as separate tasks for idle workers to steal.
+ *
+ * With a RenderCache (see `set_cache`), a document whose output is in the cache is only copied from it.
+ * Any other document is rendered into memory, written out and stored in the cache along with the CSS
+ * classes it uses.
+ *
+ * @see Md_Parser
+ * @see HTML_Builder
+ */
+class BatchConverter
+{
+public:
+    /**
+     * @param logger A pointer to the overarching Logger instance.
+     * @param workers The number of worker threads.
+     * @param stream Whether to convert the documents block by block (see Md_Parser::set_block_handler).
+     */
+    BatchConverter(Logger* logger, size_t workers, bool stream)
+    : logger(logger),
+      stream(stream),
+      scheduler(workers) {}
+
+    /**
+     * @brief Lists the documents of a batch.
+     *
+     * A directory is searched recursively for `.md` files. Any other file is read as a manifest: one path per line,
+     * relative to the manifest's directory unless absolute; empty lines and lines starting with `#` are skipped.
+     * The output of a document is its path relative to the directory (or to the manifest's directory) with the
+     * extension `.html`, under `output_dir`. Documents outside of that directory are placed right in `output_dir`.
+     *
+     * @param source The directory or the manifest.
+     * @param output_dir The directory to write the HTML files to.
+     * @param stylesheet The path of the shared stylesheet.
+     * @return The documents in a stable order, or std::nullopt if the source cannot be read.
+     */
+    static std::optional<std::vector<BatchJob>> collect_jobs(const fs::path& source, const fs::path& output_dir, const fs::path& stylesheet)
+    {
+        std::vector<fs::path> inputs;
+        fs::path base;
+        std::error_code error;
+        if (fs::is_directory(source, error))
+        {
+            base = source;
+            for (auto it = fs::recursive_directory_iterator(source, error); !error && it != fs::recursive_directory_iterator(); it.increment(error))
+            {
+                if (it->is_regular_file(error) && it->path().extension() == ".md")
+                    inputs.push_back(it->path());
+            }
+            if (error)
+                return std::nullopt;
+            std::sort(inputs.begin(), inputs.end());
+        }
+        else
+        {
+            std::ifstream manifest(source);
+            if (manifest.fail())
+                return std::nullopt;
+            base = source.parent_path();
+            std::string line;
+            while (std::getline(manifest, line))
+            {
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                if (line.empty() || line[0] == '#')
+                    continue;
+                fs::path input(line);
+                inputs.push_back(input.is_absolute() ? input : base / input);
+            }
+        }
+
+        std::vector<BatchJob> jobs;
+        for (auto&& input : inputs)
+        {
+            fs::path relative = input.lexically_normal().lexically_relative(base.lexically_normal());
+            if (relative.empty() || *relative.begin() == "..")
+                relative = input.filename();
+            fs::path output = output_dir / relative;
+            output.replace_extension(".html");
+            std::string link = stylesheet.lexically_normal().lexically_relative(output.parent_path().lexically_normal()).generic_string();
+            std::error_code size_error;
+            uintmax_t size = fs::file_size(input, size_error);
+            jobs.push_back(BatchJob{input, output, link.empty() ? stylesheet.generic_string() : link, size_error ? 0 : size});
+        }
+        return jobs;
+    }
+
+    /**
+     * @brief Converts all documents. A document which fails is reported and skipped.
+     * @param jobs The documents to convert.
+     * @return The number of documents converted successfully.
+     */
+    size_t convert(const std::vector<BatchJob>& jobs)
+    {
+        jobs_begin = jobs.data();
+        document_stats = std::vector<std::string>(collect_stats ? jobs.size() : 0);
+        for (size_t i = 0; i < scheduler.worker_count(); ++i)
+        {
+            html_builders.push_back(std::make_unique<HTML_Builder>(logger));
+            html_builders.back()->set_css_builder();
+            arenas.push_back(std::make_shared<NodeArena>());
+        }
+        cached_attributes = std::vector<std::set<Attribute>>(scheduler.worker_count());
+
+        std::vector<const BatchJob*> order;
+        for (auto&& job : jobs)
+            order.push_back(&job);
+        std::stable_sort(order.begin(), order.end(), [](const BatchJob* a, const BatchJob* b) { return a->size > b->size; });
+        std::vector<WorkScheduler::Task> tasks;
+        for (const BatchJob* job : order)
+            tasks.push_back([this, job](size_t worker) { convert_document(*job, worker); });
+        scheduler.seed(std::move(tasks));
+        scheduler.run();
+
+        for (auto&& html_builder : html_builders)
+            used_attributes.insert(html_builder->get_used_attributes().begin(), html_builder->get_used_attributes().end());
+        for (auto&& attributes : cached_attributes)
+            used_attributes.insert(attributes.begin(), attributes.end());
+        return converted;
+    }
+
+    /**
+     * @brief Writes the stylesheet shared by the converted documents.
+     * @param styles_stream The output sink for the CSS file.
+     */
+    void write_stylesheet(OutputSink& styles_stream)
+    {
+        CSS_Constructor css_builder(styles_stream);
+        css_builder.create_default_styling();
+        for (Attribute attr : used_attributes)
+            css_builder.add_css_attr_class(attr);
+    }
+
+    /**
+     * @brief Looks the documents up in `cache` before converting them, and stores those converted. Off by default.
+     */
+    void set_cache(RenderCache* cache)
+    {
+        this->cache = cache;
+    }
+
+    /**
+     * @brief Collects the statistics of every document while converting (see Stats). Off by default.
+     */
+    void set_collect_stats(bool collect)
+    {
+        collect_stats = collect;
+    }
+
+    /**
+     * @brief Writes the statistics of the converted documents as a JSON object, valid after `convert`.
+     * @param stylesheet_bytes The size of the shared stylesheet.
+     * @param wall_seconds The time the whole batch took.
+     */
+    void write_stats_json(std::ostream& out, size_t stylesheet_bytes, double wall_seconds) const
+    {
+        out << "{\"documents\":[";
+        for (size_t i = 0; i < document_stats.size(); ++i)
+            out << (i == 0 ? "" : ",") << (document_stats[i].empty() ? "null" : document_stats[i]);
+        out << "],\"stylesheet_bytes\":" << stylesheet_bytes << ",\"wall_seconds\":" << wall_seconds
+            << ",\"peak_rss_bytes\":" << Stats::peak_rss_bytes();
+        if (cache != nullptr)
+        {
+            out << ",\"cache\":";
+            cache->write_counters_json(out);
+        }
+        out << '}';
+    }
+
+    /**
+     * @brief Returns how busy each worker has been, valid after `convert`.
+     */
+    const std::vector<WorkerStats>& get_worker_stats() const
+    {
+        return scheduler.get_stats();
+    }
+
+private:
+    Logger* logger;
+    bool stream;
+    WorkScheduler scheduler;
+    std::vector<std::unique_ptr<HTML_Builder>> html_builders;  // one per worker
+    std::vector<std::shared_ptr<NodeArena>> arenas;  // one per worker
+    std::atomic<size_t> converted = 0;
+    std::mutex console_mutex;
+    std::set<Attribute> used_attributes;
+    RenderCache* cache = nullptr;
+    std::vector<std::set<Attribute>> cached_attributes;  // one per worker, of the documents rendered with the cache
+    bool collect_stats = false;
+    const BatchJob* jobs_begin = nullptr;
+    std::vector<std::string> document_stats;  // the JSON of each job, in the order of the jobs
+
+    /**
+     * @brief A document being converted, shared by the tasks parsing its segments.
+     */
+    struct Document
+    {
+        Document(const BatchJob& job, std::unique_ptr<Logger> log, bool collect_stats)
+        : job(job), log(std::move(log)), stats(collect_stats ? std::make_unique<Stats>() : nullptr) {}
+
+        const BatchJob& job;
+        std::unique_ptr<Logger> log;
+        InputSource input;
+        std::unique_ptr<ParallelParser> parser;
+        std::atomic<size_t> remaining = 0;  // the segments not parsed yet
+        std::unique_ptr<Stats> stats;  // null if not collecting
+        CacheKey key;  // valid with a cache
+    };
+
+    /**
+     * @brief Converts a single document. A document large enough to be split is parsed in segments
+     * spawned as separate tasks, the one parsing the last segment then writes the document.
+     */
+    void convert_document(const BatchJob& job, size_t worker)
+    {
+        std::shared_ptr<Document> document = std::make_shared<Document>(job, Logger::recording(*logger), collect_stats);
+        Stats* stats = document->stats.get();
+        std::string failure;
+        try {
+            LOG_INFO(document->log, "Starting parsing.");
+            bool opened;
+            {
+                PhaseTimer timer(stats, Read);
+                opened = document->input.open(job.input.string());
+            }
+            if (stats != nullptr)
+                stats->bytes_in = document->input.view().size();
+            if (!opened)
+                failure = "unable to open the input file";
+            else if (cache != nullptr && copy_cached(*document, worker))
+                LOG_INFO(document->log, "Copied the output from the cache.");
+            else if (!stream && scheduler.worker_count() > 1 && document->input.view().size() >= 2 * PARALLEL_MIN_SEGMENT_SIZE)
+            {
+                document->parser = std::make_unique<ParallelParser>(document->input, document->log.get(), scheduler.worker_count());
+                document->parser->set_stats(stats);  // the segments are counted once assembled
+                size_t count = document->parser->split();
+                document->remaining = count;
+                // spawned in reverse, so that the owner continues with the next segment and thieves take the last ones
+                for (size_t i = count - 1; i > 0; --i)
+                    scheduler.spawn(worker, [this, document, i](size_t worker) { parse_segment(document, i, worker); });
+                parse_segment(document, 0, worker);
+                return;
+            }
+            else
+            {
+                Md_Parser parser(document->input, document->log.get(), arenas[worker]);
+                parser.set_stats(stats);
+                if (stream)
+                    failure = stream_document(*document, worker, parser);
+                else
+                    failure = write_document(*document, worker, parser.parse_document());
+            }
+        } catch (std::runtime_error& err) {
+            failure = err.what();
+            arenas[worker]->reset();  // the tree of the failed document was never handed out
+        }
+        finish(*document, failure);
+    }
+
+    /**
+     * @brief Parses a segment of a split document and, if it is the last one to finish, writes the document.
+     */
+    void parse_segment(const std::shared_ptr<Document>& document, size_t segment, size_t worker)
+    {
+        document->parser->parse_segment_at(segment);
+        if (--document->remaining != 0)
+            return;
+
+        std::string failure;
+        try {
+            failure = write_document(*document, worker, document->parser->assemble());
+        } catch (std::runtime_error& err) {
+            failure = err.what();
+        }
+        finish(*document, failure);
+    }
+
+    /**
+     * @brief Writes the HTML of a parsed document.
+     * @return The reason of a failure, empty if the document has been written.
+     */
+    std::string write_document(Document& document, size_t worker, TreeRoot root)
+    {
+        OutputSink output_stream;
+        if (!open_output(document, worker, output_stream))
+            return "unable to open the output file";
+        LOG_INFO(document.log, "Starting html building");
+        if (document.stats != nullptr)
+        {
+            for (auto&& child : root->children)
+                document.stats->count_nodes(*child);
+        }
+        html_builders[worker]->set_stats(document.stats.get());
+        html_builders[worker]->build_document(output_stream, document.job.stylesheet_link, std::move(root));
+        html_builders[worker]->set_stats(nullptr);
+        if (document.stats != nullptr)
+            document.stats->html_bytes_out = output_stream.get_bytes_written();
+        return close_output(document, worker, output_stream);
+    }
+
+    /**
+     * @brief Parses a document block by block, writing each block right away (see Md_Parser::set_block_handler).
+     * @return The reason of a failure, empty if the document has been written.
+     */
+    std::string stream_document(Document& document, size_t worker, Md_Parser& parser)
+    {
+        OutputSink output_stream;
+        if (!open_output(document, worker, output_stream))
+            return "unable to open the output file";
+        Stats* stats = document.stats.get();
+        HTML_Builder& html_builder = *html_builders[worker];
+        html_builder.set_stats(stats);
+        html_builder.begin_stream(output_stream, document.job.stylesheet_link);
+        parser.set_block_handler([&html_builder, stats](Node& block) {
+            if (stats != nullptr)
+                stats->count_nodes(block);
+            html_builder.stream_block(block);
+        });
+        parser.parse_document();
+        html_builder.end_stream();
+        html_builder.set_stats(nullptr);
+        if (stats != nullptr)
+            stats->html_bytes_out = output_stream.get_bytes_written();
+        return close_output(document, worker, output_stream);
+    }
+
+    /**
+     * @brief Looks a document up in the cache and on a hit writes its HTML from there.
+     * @return Whether the document was in the cache. A hit whose output cannot be written counts as a miss.
+     */
+    bool copy_cached(Document& document, size_t worker)
+    {
+        document.key = RenderCache::key(document.input.view(), document.job.stylesheet_link);
+        std::shared_ptr<const CachedRender> entry = cache->lookup(document.key);
+        if (entry == nullptr)
+            return false;
+        OutputSink output_stream;
+        std::error_code error;
+        fs::create_directories(document.job.output.parent_path(), error);
+        if (!output_stream.open(document.job.output.string()))
+            return false;
+        output_stream << entry->html;
+        output_stream.close();
+        cached_attributes[worker].insert(entry->attributes.begin(), entry->attributes.end());
+        if (document.stats != nullptr)
+            document.stats->html_bytes_out = entry->html.size();
+        return true;
+    }
+
+    /**
+     * @brief Opens the output of a document: its file, or with a cache, memory (see `close_output`).
+     * @return Whether the output could be opened.
+     */
+    bool open_output(Document& document, size_t worker, OutputSink& output_stream)
+    {
+        if (cache != nullptr)
+        {
+            output_stream.open_memory();
+            html_builders[worker]->set_css_builder();  // to tell the attributes of this document alone
+            return true;
+        }
+        std::error_code error;
+        fs::create_directories(document.job.output.parent_path(), error);
+        return output_stream.open(document.job.output.string());
+    }
+
+    /**
+     * @brief Closes the output of a document. With a cache, writes the HTML collected in memory to its file
+     * and stores it in the cache.
+     * @return The reason of a failure, empty if the document has been written.
+     */
+    std::string close_output(Document& document, size_t worker, OutputSink& output_stream)
+    {
+        if (cache == nullptr)
+        {
+            output_stream.close();
+            return "";
+        }
+        const std::vector<Attribute>& attributes = html_builders[worker]->get_attributes_in_order();
+        cached_attributes[worker].insert(attributes.begin(), attributes.end());
+        OutputSink file;
+        std::error_code error;
+        fs::create_directories(document.job.output.parent_path(), error);
+        if (!file.open(document.job.output.string()))
+            return "unable to open the output file";
+        file << output_stream.contents();
+        file.close();
+        cache->store(document.key, output_stream.contents(), attributes);
+        return "";
+    }
+
+    /**
+     * @brief Logs the messages of a document, keeps its statistics and reports a failure to the console.
+     * @param failure The reason of the failure, empty if the document has been converted.
+     */
+    void finish(Document& document, const std::string& failure)
+    {
+        document.log->replay(*logger, document.job.input.string());
+        if (document.stats != nullptr)
+        {
+            std::ostringstream json;
+            document.stats->write_json(json, document.job.input.string(), false);
+            document_stats[&document.job - jobs_begin] = json.str();
+        }
+        if (failure.empty())
+        {
+            ++converted;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(console_mutex);
+        std::cerr << "Error converting " << document.job.input.string() << ": " << failure << std::endl;
+    }
+};
+
+#endif
@@ -0,0 +1,145 @@
+/**
+ * @file alloc_bench.cpp
+ * @brief Counts the heap allocations of converting a document, by phase and call site (see AllocationProfile).
+ *
+ * Usage: alloc_bench [options]
+ *
+ *   -i *path*            the document to convert (by default a synthetic one mixing all kinds of blocks)
+ *   --size *bytes*       the size of the synthetic document (1048576 by default)
+ *   --seed *n*           the seed of the synthetic document (42 by default)
+ *   --max-per-kb *n*     fail if there are more than `n` allocations per KB of input
+ *                        (ALLOC_BENCH_MAX_PER_KB by default, 0 never fails)
+ *
+ * The document is read, parsed into a tree and rendered into scratch files once, the way main does it
+ * with --stats, and the allocation profile is written to standard output. The exit code is 1 when the
+ * allocations per KB of input exceed the limit, so a change which allocates more than the recorded
+ * baseline is caught by running alloc_bench. Lower the baseline whenever allocations are taken out.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+#include "../alloc_accounting.hpp"
+#include "../error_handler.hpp"
+#include "../stats.hpp"
+#include "../parsing/input_source.hpp"
+#include "../parsing/markdown_parser.hpp"
+#include "../building/html_constructor.hpp"
+#include "../building/output_sink.hpp"
+#include "corpus_generator.hpp"
+
+/**
+ * @brief The allocations per KB of the default synthetic document (3.26 when recorded), with some room for differences
+ * between standard libraries.
+ */
+#ifndef ALLOC_BENCH_MAX_PER_KB
+#define ALLOC_BENCH_MAX_PER_KB 3.5
+#endif
+
+static std::string generate(size_t bytes, unsigned long long seed)
+{
+    const std::vector<CorpusGenerator::BlockWriter> writers = {
+        &CorpusGenerator::paragraph, &CorpusGenerator::heading, &CorpusGenerator::emphasis,
+        &CorpusGenerator::inline_code, &CorpusGenerator::fenced_code, &CorpusGenerator::unordered_list,
+        &CorpusGenerator::ordered_list, &CorpusGenerator::links, &CorpusGenerator::table,
+    };
+    CorpusGenerator gen(seed);
+    std::string text;
+    while (text.size() < bytes)
+        (gen.*writers[gen.next(writers.size())])(text);
+    return text;
+}
+
+static int usage()
+{
+    std::cerr << "Usage: alloc_bench [-i path] [--size bytes] [--seed n] [--max-per-kb n]" << std::endl;
+    return 2;
+}
+
+int main(int argc, char** argv)
+{
+    std::string input_path;
+    size_t size = 1 << 20;
+    unsigned long long seed = 42;
+    double max_per_kb = ALLOC_BENCH_MAX_PER_KB;
+
+    std::vector<std::string> args(argv + 1, argv + argc);
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        if (i + 1 >= args.size())
+            return usage();
+        const std::string& name = args[i];
+        const std::string& value = args[++i];
+        try {
+            if (name == "-i")
+                input_path = value;
+            else if (name == "--size")
+                size = std::stoull(value);
+            else if (name == "--seed")
+                seed = std::stoull(value);
+            else if (name == "--max-per-kb")
+                max_per_kb = std::stod(value);
+            else
+                return usage();
+        } catch (std::exception&) {
+            return usage();
+        }
+    }
+
+    std::string generated;
+    if (input_path.empty())
+        generated = generate(size, seed);
+
+    Logger logger;
+    Stats stats;
+    AllocationProfile::reset();
+    InputSource input;
+    {
+        PhaseTimer timer(&stats, Read);
+        if (!input_path.empty() && !input.open(input_path))
+        {
+            std::cerr << "Unable to open " << input_path << std::endl;
+            return 2;
+        }
+    }
+    std::string_view text = input_path.empty() ? std::string_view(generated) : input.view();
+
+    OutputSink output;
+    OutputSink styles;
+    if (!output.open("alloc_bench_output.html") || !styles.open("alloc_bench_styles.css"))
+    {
+        std::cerr << "Unable to open the scratch output files" << std::endl;
+        return 2;
+    }
+    try {
+        Md_Parser parser(text, &logger);
+        parser.set_stats(&stats);
+        TreeRoot root = nullptr;
+        {
+            PhaseTimer timer(&stats, Parse);
+            root = parser.parse_document();
+        }
+        HTML_Builder builder(&logger);
+        builder.set_css_builder(styles);
+        builder.set_stats(&stats);
+        builder.build_document(output, "styles.css", std::move(root));
+        output.close();
+        styles.close();
+    } catch (std::runtime_error& err) {
+        std::cerr << "Error converting the document: " << err.what() << std::endl;
+        return 2;
+    }
+    std::remove("alloc_bench_output.html");
+    std::remove("alloc_bench_styles.css");
+
+    AllocationProfile::write_report(std::cout, phase_names, text.size());
+    double per_kb = AllocationProfile::per_kb(AllocationProfile::total().allocations, text.size() / 1024.0);
+    if (max_per_kb > 0 && per_kb > max_per_kb)
+    {
+        std::cout << "\nFAILED: " << per_kb << " allocations/KB, the limit is " << max_per_kb << std::endl;
+        return 1;
+    }
+    return 0;
+}
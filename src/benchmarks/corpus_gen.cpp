@@ -0,0 +1,195 @@
+/**
+ * @file corpus_gen.cpp
+ * @brief Writes a synthetic Markdown document of any size (see CorpusGenerator).
+ *
+ * Usage: corpus_gen [options]
+ *
+ *   -o *path*            where to write the document (standard output by default)
+ *   --size *bytes*       the size to reach, with an optional K, M or G suffix (1M by default)
+ *   --seed *n*           the seed; the same seed and options always give the same document (42 by default)
+ *   --mix *weights*      the relative frequency of each kind of block, e.g. paragraphs=4,tables=1;
+ *                        kinds left out keep their default weight, 0 leaves a kind out
+ *   --list-depth *n*     the deepest nesting of lists (4 by default)
+ *   --table-columns *n*  the most columns of a table (8 by default)
+ *   --table-rows *n*     the most rows of a table (20 by default)
+ *   --code-lines *n*     the most lines of a fenced code block (60 by default)
+ *   --adversarial *mode* instead of the mix, stress the parser with one of
+ *                        asterisks (a single line of `--size` asterisks),
+ *                        nesting (lists nested `--depth` levels deep, 1000 by default),
+ *                        unterminated-tables (tables broken in several ways)
+ *
+ * The kinds of blocks are paragraphs, headings, emphasis, inline_code, fenced_code, unordered_lists,
+ * ordered_lists, links and tables. Once the size is reached, the current block is finished, so
+ * the document ends up slightly larger.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <optional>
+
+#include "corpus_generator.hpp"
+
+/**
+ * @brief Parses a size like 512, 64K, 100M or 2G.
+ */
+static std::optional<size_t> parse_size(const std::string& text)
+{
+    size_t end;
+    size_t value;
+    try {
+        value = std::stoull(text, &end);
+    } catch (std::exception&) {
+        return std::nullopt;
+    }
+    std::string suffix = text.substr(end);
+    if (suffix.empty())
+        return value;
+    if (suffix == "K" || suffix == "k")
+        return value << 10;
+    if (suffix == "M" || suffix == "m")
+        return value << 20;
+    if (suffix == "G" || suffix == "g")
+        return value << 30;
+    return std::nullopt;
+}
+
+/**
+ * @brief Parses a list of kind=weight pairs separated by commas into `weights`.
+ * @return Whether every pair named a known kind and a number.
+ */
+static bool parse_mix(const std::string& text, std::map<std::string, size_t>& weights)
+{
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        size_t comma = text.find(',', pos);
+        if (comma == std::string::npos)
+            comma = text.size();
+        std::string pair = text.substr(pos, comma - pos);
+        size_t equals = pair.find('=');
+        if (equals == std::string::npos || weights.find(pair.substr(0, equals)) == weights.end())
+            return false;
+        try {
+            weights[pair.substr(0, equals)] = std::stoul(pair.substr(equals + 1));
+        } catch (std::exception&) {
+            return false;
+        }
+        pos = comma + 1;
+    }
+    return true;
+}
+
+static int usage()
+{
+    std::cerr << "Usage: corpus_gen [-o path] [--size bytes] [--seed n] [--mix kind=weight,...] [--list-depth n] "
+        "[--table-columns n] [--table-rows n] [--code-lines n] [--adversarial asterisks|nesting|unterminated-tables] "
+        "[--depth n]" << std::endl;
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    std::string output_path;
+    size_t size = 1 << 20;
+    unsigned long long seed = 42;
+    std::string adversarial;
+    size_t depth = 1000;
+    CorpusShape shape;
+    shape.list_depth = 4;
+    shape.table_columns = 8;
+    shape.table_rows = 20;
+    shape.code_lines = 60;
+    std::map<std::string, size_t> weights = {
+        {"paragraphs", 6}, {"headings", 2}, {"emphasis", 2}, {"inline_code", 1}, {"fenced_code", 1},
+        {"unordered_lists", 2}, {"ordered_lists", 1}, {"links", 2}, {"tables", 1},
+    };
+
+    std::vector<std::string> args(argv + 1, argv + argc);
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        if (i + 1 >= args.size())
+            return usage();
+        const std::string& name = args[i];
+        const std::string& value = args[++i];
+        std::optional<size_t> number = parse_size(value);
+        if (name == "-o")
+            output_path = value;
+        else if (name == "--mix")
+        {
+            if (!parse_mix(value, weights))
+                return usage();
+        }
+        else if (name == "--adversarial")
+        {
+            if (value != "asterisks" && value != "nesting" && value != "unterminated-tables")
+                return usage();
+            adversarial = value;
+        }
+        else if (!number.has_value())
+            return usage();
+        else if (name == "--size")
+            size = *number;
+        else if (name == "--seed")
+            seed = *number;
+        else if (name == "--depth")
+            depth = *number;
+        else if (name == "--list-depth")
+            shape.list_depth = *number;
+        else if (name == "--table-columns")
+            shape.table_columns = *number;
+        else if (name == "--table-rows")
+            shape.table_rows = *number;
+        else if (name == "--code-lines")
+            shape.code_lines = *number;
+        else
+            return usage();
+    }
+
+    std::ofstream file;
+    if (!output_path.empty())
+    {
+        file.open(output_path, std::ios::binary);
+        if (file.fail())
+        {
+            std::cerr << "Unable to open " << output_path << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = output_path.empty() ? std::cout : file;
+
+    std::map<std::string, CorpusGenerator::BlockWriter> writers = {
+        {"paragraphs", &CorpusGenerator::paragraph}, {"headings", &CorpusGenerator::heading},
+        {"emphasis", &CorpusGenerator::emphasis}, {"inline_code", &CorpusGenerator::inline_code},
+        {"fenced_code", &CorpusGenerator::fenced_code}, {"unordered_lists", &CorpusGenerator::unordered_list},
+        {"ordered_lists", &CorpusGenerator::ordered_list}, {"links", &CorpusGenerator::links},
+        {"tables", &CorpusGenerator::table},
+    };
+    std::vector<CorpusGenerator::BlockWriter> weighted;  // every writer as many times as its weight
+    for (auto&& [kind, weight] : weights)
+        weighted.insert(weighted.end(), weight, writers[kind]);
+    if (weighted.empty() && adversarial.empty())
+        return usage();
+
+    CorpusGenerator gen(seed, shape);
+    std::string block;
+    size_t written = 0;
+    while (written < size)
+    {
+        block.clear();
+        if (adversarial == "asterisks")
+            gen.asterisks(block, size);
+        else if (adversarial == "nesting")
+            gen.nested_list(block, depth);
+        else if (adversarial == "unterminated-tables")
+            gen.unterminated_table(block);
+        else
+            (gen.*weighted[gen.next(weighted.size())])(block);
+        out << block;
+        written += block.size();
+    }
+    out.flush();
+    return out.fail() ? 1 : 0;
+}
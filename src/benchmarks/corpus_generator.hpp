@@ -0,0 +1,206 @@
+/**
+ * @file corpus_generator.hpp
+ * @brief Generating synthetic Markdown documents, shared by corpus_gen and markdown_bench.
+ */
+
+#ifndef _CORPUS_GENERATOR_HPP
+#define _CORPUS_GENERATOR_HPP
+
+#include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+
+/**
+ * @struct CorpusShape
+ * @brief The upper bounds of the sizes of generated blocks.
+ */
+struct CorpusShape
+{
+    size_t list_depth = 2;  // the deepest nesting of list items
+    size_t table_columns = 5;
+    size_t table_rows = 7;
+    size_t code_lines = 10;
+};
+
+/**
+ * @class CorpusGenerator
+ * @brief Appends blocks of Markdown to a string, varied by a seeded linear congruential generator, so that
+ *        the same seed and shape always give the same document.
+ *
+ * Every block ends with an empty line, so blocks never run into each other. The adversarial blocks
+ * (`asterisks`, `nested_list`, `unterminated_table`) are meant to stress the parser rather than to look
+ * like real documents.
+ */
+class CorpusGenerator
+{
+public:
+    using BlockWriter = void (CorpusGenerator::*)(std::string&);
+
+    CorpusGenerator(unsigned long long seed = 42, CorpusShape shape = CorpusShape())
+    : state(seed),
+      shape(shape) {}
+
+    /**
+     * @brief Returns a number in [0, bound).
+     */
+    size_t next(size_t bound)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return bound == 0 ? 0 : (state >> 33) % bound;
+    }
+
+    std::string words(size_t count)
+    {
+        static constexpr std::array<const char*, 18> vocabulary = {
+            "lorem", "ipsum", "dolor", "sit", "amet", "parser", "state", "token", "render", "tree",
+            "markdown", "consectetur", "adipiscing", "elit", "sed", "do", "eiusmod", "tempor"
+        };
+        std::string text;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i != 0)
+                text += ' ';
+            text += vocabulary[next(vocabulary.size())];
+        }
+        return text;
+    }
+
+    void paragraph(std::string& text)
+    {
+        for (size_t i = 0, lines = 1 + next(4); i < lines; ++i)
+            text += words(6 + next(10)) + (i + 1 < lines ? "\n" : "");
+        text += "\n\n";
+    }
+
+    void heading(std::string& text)
+    {
+        text += std::string(1 + next(6), '#') + ' ' + words(2 + next(6)) + "\n\n";
+    }
+
+    void emphasis(std::string& text)
+    {
+        static constexpr std::array<const char*, 3> markers = {"*", "**", "***"};
+        for (size_t i = 0; i < 8; ++i)
+        {
+            std::string marker = markers[next(markers.size())];
+            text += words(1 + next(4)) + ' ' + marker + words(1 + next(3)) + marker + ' ';
+        }
+        text += words(3) + "\n\n";
+    }
+
+    void inline_code(std::string& text)
+    {
+        for (size_t i = 0; i < 8; ++i)
+            text += words(1 + next(4)) + " `" + words(1 + next(3)) + "` ";
+        text += words(3) + "\n\n";
+    }
+
+    void fenced_code(std::string& text)
+    {
+        text += "```\n";
+        for (size_t i = 0, lines = 1 + next(shape.code_lines); i < lines; ++i)
+            text += std::string(4 * next(3), ' ') + words(2 + next(6)) + ";\n";
+        text += "```\n\n";
+    }
+
+    void unordered_list(std::string& text)
+    {
+        list_items(text, 0, [](size_t) { return std::string("- "); });
+        text += "\n\n";
+    }
+
+    void ordered_list(std::string& text)
+    {
+        list_items(text, 0, [](size_t i) { return std::to_string(i + 1) + ". "; });
+        text += "\n\n";
+    }
+
+    void links(std::string& text)
+    {
+        for (size_t i = 0; i < 4; ++i)
+        {
+            text += words(1 + next(4)) + " [" + words(1 + next(3)) + "](https://example.com/"
+                + std::to_string(next(1000)) + " \"" + words(2) + "\") ";
+            if (next(2) == 0)
+                text += "![" + words(2) + "](images/" + std::to_string(next(1000)) + ".png) ";
+        }
+        text += words(3) + "\n\n";
+    }
+
+    void table(std::string& text)
+    {
+        size_t columns = 2 + next(std::max<size_t>(shape.table_columns, 2) - 1);
+        for (size_t i = 0; i < columns; ++i)
+            text += "| " + words(1) + ' ';
+        text += "|\n";
+        for (size_t i = 0; i < columns; ++i)
+            text += "|---";
+        text += "|\n";
+        for (size_t row = 0, rows = 1 + next(shape.table_rows); row < rows; ++row)
+        {
+            for (size_t i = 0; i < columns; ++i)
+                text += "| " + words(1 + next(2)) + ' ';
+            text += "|\n";
+        }
+        text += "\n\n";
+    }
+
+    /**
+     * @brief A single line of `count` asterisks.
+     */
+    void asterisks(std::string& text, size_t count)
+    {
+        text += std::string(count, '*') + "\n\n";
+    }
+
+    /**
+     * @brief An unordered list nested `depth` levels deep, one item per level.
+     */
+    void nested_list(std::string& text, size_t depth)
+    {
+        for (size_t level = 0; level < depth; ++level)
+            text += std::string(4 * level, ' ') + "- " + words(2) + '\n';
+        text += "\n\n";
+    }
+
+    /**
+     * @brief A table broken in one of several ways: no separator row, a row without its closing pipe,
+     *        a separator with fewer columns, or a row cut off by an empty line.
+     */
+    void unterminated_table(std::string& text)
+    {
+        switch (next(4))
+        {
+        case 0:
+            text += "| " + words(1) + " | " + words(1) + " |\n" + words(4) + "\n\n";
+            break;
+        case 1:
+            text += "| " + words(1) + " | " + words(1) + " |\n|---|---|\n| " + words(2) + " | " + words(2) + "\n\n";
+            break;
+        case 2:
+            text += "| " + words(1) + " | " + words(1) + " | " + words(1) + " |\n|---|\n| a | b | c |\n\n";
+            break;
+        default:
+            text += "| " + words(1) + " | " + words(1) + " |\n|---|---|\n| " + words(2) + "\n\n| b |\n\n";
+            break;
+        }
+    }
+
+private:
+    unsigned long long state;
+    CorpusShape shape;
+
+    template <typename Marker>
+    void list_items(std::string& text, size_t level, Marker marker)
+    {
+        for (size_t i = 0, items = 2 + next(5); i < items; ++i)
+        {
+            text += std::string(4 * level, ' ') + marker(i) + words(2 + next(6)) + '\n';
+            if (level + 1 < shape.list_depth && next(3) == 0)
+                list_items(text, level + 1, marker);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,159 @@
+/**
+ * @file markdown_bench.cpp
+ * @brief Micro-benchmarks of parsing and rendering, one per family of Markdown constructs.
+ *
+ * Usage: markdown_bench [megabytes] [repetitions] [family...]
+ *
+ * For every family (headings, emphasis, inline_code, fenced_code, unordered_lists, ordered_lists, links,
+ * tables, or the ones named), a synthetic document of about `megabytes` MB (1 by default) made of that
+ * construct only is generated from a fixed seed (see CorpusGenerator). It is then parsed (parse), parsed
+ * into a stream of events without a tree (events, see TokenSink), rendered from an already parsed tree
+ * (render) and both (end-to-end), each `repetitions` times (7 by default) after one untimed warm-up run.
+ * The fastest and the median run are reported in MB/s of Markdown input.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <cstdio>
+
+#include "../error_handler.hpp"
+#include "../parsing/markdown_parser.hpp"
+#include "../building/html_constructor.hpp"
+#include "../building/output_sink.hpp"
+#include "corpus_generator.hpp"
+
+static std::string generate(CorpusGenerator::BlockWriter write_block, size_t bytes)
+{
+    CorpusGenerator gen;
+    std::string text;
+    while (text.size() < bytes)
+        (gen.*write_block)(text);
+    return text;
+}
+
+/**
+ * @brief Runs `body` once untimed, then `repetitions` times, and returns the sorted seconds of the runs.
+ * `prepare` runs untimed before every run.
+ */
+static std::vector<double> measure(size_t repetitions, const std::function<void()>& prepare, const std::function<void()>& body)
+{
+    prepare();
+    body();
+    std::vector<double> seconds;
+    for (size_t i = 0; i < repetitions; ++i)
+    {
+        prepare();
+        auto start = std::chrono::steady_clock::now();
+        body();
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+        seconds.push_back(took.count());
+    }
+    std::sort(seconds.begin(), seconds.end());
+    return seconds;
+}
+
+static void report(const std::string& family, const std::string& phase, size_t bytes, const std::vector<double>& seconds)
+{
+    double megabytes = bytes / 1e6;
+    double fastest = seconds.front();
+    double median = seconds[seconds.size() / 2];
+    std::cout << std::left << std::setw(18) << family << std::setw(12) << phase << std::right << std::fixed
+        << std::setprecision(1) << std::setw(10) << megabytes / fastest << " MB/s (min "
+        << std::setprecision(3) << fastest * 1000 << " ms)"
+        << std::setprecision(1) << std::setw(10) << megabytes / median << " MB/s (median "
+        << std::setprecision(3) << median * 1000 << " ms)" << std::defaultfloat << std::endl;
+}
+
+/**
+ * @class CountingSink
+ * @brief Only counts the events it receives, like a consumer which needs no tree.
+ */
+class CountingSink : public TokenSink
+{
+public:
+    size_t events = 0;
+    size_t characters = 0;
+
+    void consume_token(Token token) override
+    {
+        ++events;
+        characters += token.text.size();
+    }
+
+    void add_attribute(Attribute) override
+    {
+        ++events;
+    }
+};
+
+/**
+ * @brief Renders a parsed document the way main does, into scratch files.
+ */
+static void render(TreeRoot root)
+{
+    Logger logger;
+    OutputSink output;
+    OutputSink styles;
+    output.open("markdown_bench_output.html");
+    styles.open("markdown_bench_styles.css");
+    HTML_Builder builder(&logger);
+    builder.set_css_builder(styles);
+    builder.build_document(output, "styles.css", std::move(root));
+    output.close();
+    styles.close();
+}
+
+int main(int argc, char** argv)
+{
+    double megabytes = argc > 1 ? std::stod(argv[1]) : 1;
+    size_t repetitions = argc > 2 ? std::max(1ul, std::stoul(argv[2])) : 7;
+
+    std::vector<std::pair<std::string, CorpusGenerator::BlockWriter>> families = {
+        {"headings", &CorpusGenerator::heading},
+        {"emphasis", &CorpusGenerator::emphasis},
+        {"inline_code", &CorpusGenerator::inline_code},
+        {"fenced_code", &CorpusGenerator::fenced_code},
+        {"unordered_lists", &CorpusGenerator::unordered_list},
+        {"ordered_lists", &CorpusGenerator::ordered_list},
+        {"links", &CorpusGenerator::links},
+        {"tables", &CorpusGenerator::table},
+    };
+    std::vector<std::string> selected(argv + std::min(argc, 3), argv + argc);
+
+    Logger logger;
+    for (auto&& [family, write_block] : families)
+    {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), family) == selected.end())
+            continue;
+        std::string text = generate(write_block, static_cast<size_t>(megabytes * 1e6));
+
+        report(family, "parse", text.size(), measure(repetitions, [] {}, [&] {
+            Md_Parser(text, &logger).parse_document();
+        }));
+
+        CountingSink sink;
+        report(family, "events", text.size(), measure(repetitions, [] {}, [&] {
+            Md_Parser parser(text, &logger);
+            parser.set_sink(&sink);
+            parser.parse_document();
+        }));
+
+        TreeRoot root;
+        report(family, "render", text.size(), measure(repetitions, [&] {
+            root = Md_Parser(text, &logger).parse_document();
+        }, [&] {
+            render(std::move(root));
+        }));
+
+        report(family, "end-to-end", text.size(), measure(repetitions, [] {}, [&] {
+            render(Md_Parser(text, &logger).parse_document());
+        }));
+    }
+    std::remove("markdown_bench_output.html");
+    std::remove("markdown_bench_styles.css");
+}
@@ -0,0 +1,245 @@
+/**
+ * @file pipeline_bench.cpp
+ * @brief Compares converting a single document on one thread with the pipeline of three (see TokenPipeline).
+ *
+ * Usage: pipeline_bench [options]
+ *
+ *   -i *path*              the document to convert (by default a synthetic one mixing all kinds of blocks)
+ *   --size *bytes*         the size of the synthetic document (16777216 by default)
+ *   --repetitions *n*      the number of timed runs of every path, after one untimed warm-up run (5 by default)
+ *
+ * Every path reads the document from its file, converts it and writes the HTML and CSS into scratch files:
+ * tree (parse into a tree, then render it, as by default), fused (render from the tokens, as with --fused)
+ * and pipeline (read, parse and render on three threads, as with --pipeline). For each, the total time and
+ * throughput in MB/s of Markdown input are reported, and the latency to the first byte: the time until the
+ * renderer got its first token (for tree, until parsing has finished). The fastest and the median run
+ * are reported. The pipeline only pays off with free cores, on a single core it is slower.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <cstdio>
+
+#include "../error_handler.hpp"
+#include "../parsing/input_source.hpp"
+#include "../parsing/streamed_input.hpp"
+#include "../parsing/markdown_parser.hpp"
+#include "../building/html_constructor.hpp"
+#include "../building/output_sink.hpp"
+#include "../token_pipeline.hpp"
+#include "corpus_generator.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static std::string generate(size_t bytes)
+{
+    const std::vector<CorpusGenerator::BlockWriter> writers = {
+        &CorpusGenerator::paragraph, &CorpusGenerator::heading, &CorpusGenerator::emphasis,
+        &CorpusGenerator::inline_code, &CorpusGenerator::fenced_code, &CorpusGenerator::unordered_list,
+        &CorpusGenerator::ordered_list, &CorpusGenerator::links, &CorpusGenerator::table,
+    };
+    CorpusGenerator gen;
+    std::string text;
+    while (text.size() < bytes)
+        (gen.*writers[gen.next(writers.size())])(text);
+    return text;
+}
+
+/**
+ * @class FirstTokenSink
+ * @brief Passes everything on to another sink, noting when the first token has been passed on.
+ */
+class FirstTokenSink : public TokenSink
+{
+public:
+    FirstTokenSink(TokenSink& target, Clock::time_point& first_token)
+    : target(target),
+      first_token(first_token) {}
+
+    void consume_token(Token token) override
+    {
+        target.consume_token(token);
+        if (!seen)
+        {
+            seen = true;
+            first_token = Clock::now();
+        }
+    }
+
+    void add_attribute(Attribute attribute) override
+    {
+        target.add_attribute(attribute);
+    }
+
+    void end_document() override
+    {
+        target.end_document();
+    }
+
+private:
+    TokenSink& target;
+    Clock::time_point& first_token;
+    bool seen = false;
+};
+
+struct Timing
+{
+    double total;
+    double first_byte;
+};
+
+/**
+ * @brief Converts the document at `path` one way and returns how long it took.
+ * @param convert Reads, parses and renders into the given sinks, setting the time of the first byte.
+ */
+static Timing run(const std::function<void(OutputSink&, OutputSink&, Clock::time_point&)>& convert)
+{
+    OutputSink output;
+    OutputSink styles;
+    if (!output.open("pipeline_bench_output.html") || !styles.open("pipeline_bench_styles.css"))
+        throw std::runtime_error("unable to open the scratch output files");
+    Clock::time_point first_byte;
+    auto start = Clock::now();
+    convert(output, styles, first_byte);
+    output.close();
+    styles.close();
+    std::chrono::duration<double> total = Clock::now() - start;
+    std::chrono::duration<double> latency = first_byte - start;
+    return Timing{total.count(), latency.count()};
+}
+
+static void report(const std::string& path, size_t bytes, std::vector<Timing> timings)
+{
+    std::vector<double> totals;
+    std::vector<double> latencies;
+    for (const Timing& timing : timings)
+    {
+        totals.push_back(timing.total);
+        latencies.push_back(timing.first_byte);
+    }
+    std::sort(totals.begin(), totals.end());
+    std::sort(latencies.begin(), latencies.end());
+    double megabytes = bytes / 1e6;
+    std::cout << std::left << std::setw(10) << path << std::right << std::fixed << std::setprecision(1)
+        << std::setw(8) << megabytes / totals.front() << " MB/s (min " << std::setprecision(3)
+        << totals.front() * 1000 << " ms, median " << totals[totals.size() / 2] * 1000 << " ms)"
+        << "   first byte: min " << latencies.front() * 1000 << " ms, median "
+        << latencies[latencies.size() / 2] * 1000 << " ms" << std::defaultfloat << std::endl;
+}
+
+static int usage()
+{
+    std::cerr << "Usage: pipeline_bench [-i path] [--size bytes] [--repetitions n]" << std::endl;
+    return 2;
+}
+
+int main(int argc, char** argv)
+{
+    std::string input_path;
+    size_t size = 1 << 24;
+    size_t repetitions = 5;
+
+    std::vector<std::string> args(argv + 1, argv + argc);
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        if (i + 1 >= args.size())
+            return usage();
+        const std::string& name = args[i];
+        const std::string& value = args[++i];
+        try {
+            if (name == "-i")
+                input_path = value;
+            else if (name == "--size")
+                size = std::stoull(value);
+            else if (name == "--repetitions")
+                repetitions = std::max<size_t>(1, std::stoull(value));
+            else
+                return usage();
+        } catch (std::exception&) {
+            return usage();
+        }
+    }
+
+    bool generated = input_path.empty();
+    if (generated)
+    {
+        input_path = "pipeline_bench_input.md";
+        std::ofstream file(input_path, std::ios::binary);
+        file << generate(size);
+        if (file.fail())
+        {
+            std::cerr << "Unable to write " << input_path << std::endl;
+            return 2;
+        }
+    }
+
+    Logger logger;
+    InputSource probe;
+    if (!probe.open(input_path))
+    {
+        std::cerr << "Unable to open " << input_path << std::endl;
+        return 2;
+    }
+    size_t bytes = probe.view().size();
+
+    const std::vector<std::pair<std::string, std::function<void(OutputSink&, OutputSink&, Clock::time_point&)>>> paths = {
+        {"tree", [&](OutputSink& output, OutputSink& styles, Clock::time_point& first_byte) {
+            InputSource input;
+            input.open(input_path);
+            Md_Parser parser(input, &logger);
+            TreeRoot root = parser.parse_document();
+            first_byte = Clock::now();
+            HTML_Builder builder(&logger);
+            builder.set_css_builder(styles);
+            builder.build_document(output, "styles.css", std::move(root));
+        }},
+        {"fused", [&](OutputSink& output, OutputSink& styles, Clock::time_point& first_byte) {
+            InputSource input;
+            input.open(input_path);
+            Md_Parser parser(input, &logger);
+            HTML_Builder builder(&logger);
+            builder.set_css_builder(styles);
+            FirstTokenSink sink(builder.begin_render(output, "styles.css"), first_byte);
+            parser.set_sink(&sink);
+            parser.parse_document();
+            builder.end_stream();
+        }},
+        {"pipeline", [&](OutputSink& output, OutputSink& styles, Clock::time_point& first_byte) {
+            StreamedInput input;
+            input.open(input_path);
+            Md_Parser parser(input, &logger);
+            HTML_Builder builder(&logger);
+            builder.set_css_builder(styles);
+            FirstTokenSink sink(builder.begin_render(output, "styles.css"), first_byte);
+            TokenPipeline pipeline(sink);
+            pipeline.run(parser, input.view());
+            builder.end_stream();
+        }},
+    };
+
+    std::cout << "Converting " << bytes << " bytes, " << std::thread::hardware_concurrency() << " cores" << std::endl;
+    try {
+        for (auto&& [name, convert] : paths)
+        {
+            run(convert);
+            std::vector<Timing> timings;
+            for (size_t i = 0; i < repetitions; ++i)
+                timings.push_back(run(convert));
+            report(name, bytes, timings);
+        }
+    } catch (std::runtime_error& err) {
+        std::cerr << "Error converting the document: " << err.what() << std::endl;
+        return 2;
+    }
+    std::remove("pipeline_bench_output.html");
+    std::remove("pipeline_bench_styles.css");
+    if (generated)
+        std::remove(input_path.c_str());
+    return 0;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file scanner_bench.cpp
+ * @brief Measures bytes per cycle of the plain-text fast skip (see text_scanner.hpp).
+ *
+ * Usage: scanner_bench [markdown-file] [scale] [repetitions]
+ *
+ * The input (defaulting to ../test_files/complex_example.md) is concatenated `scale` times. The
+ * scanner kernels are first run on their own over the whole input, then the full parser is run with
+ * the fast skip turned off (before) and on (after).
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <chrono>
+
+#include "../error_handler.hpp"
+#include "../parsing/input_source.hpp"
+#include "../parsing/markdown_parser.hpp"
+#include "../parsing/text_scanner.hpp"
+
+#ifdef TEXT_SCANNER_X86
+#include <x86intrin.h>
+#endif
+
+/**
+ * @brief Returns the current cycle count, or nanoseconds where no cycle counter is available.
+ */
+static unsigned long long read_cycles()
+{
+#ifdef TEXT_SCANNER_X86
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * @brief Runs `body` `repetitions` times and returns the fewest cycles a single run took.
+ */
+template <typename Body>
+static unsigned long long min_cycles(size_t repetitions, Body&& body)
+{
+    unsigned long long best = ~0ULL;
+    for (size_t i = 0; i < repetitions; ++i)
+    {
+        unsigned long long start = read_cycles();
+        body();
+        best = std::min(best, read_cycles() - start);
+    }
+    return best;
+}
+
+static void report(const std::string& name, size_t bytes, unsigned long long cycles)
+{
+    std::cout << name << ": " << static_cast<double>(bytes) / cycles << " bytes/cycle" << std::endl;
+}
+
+/**
+ * @brief Walks the whole buffer the way the parser does: skip a run, step over the special byte, repeat.
+ */
+static size_t count_specials(text_scanner::ScanFunction scan, const std::string& text)
+{
+    size_t specials = 0;
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        pos += scan(text.data() + pos, text.size() - pos);
+        if (pos < text.size())
+        {
+            ++specials;
+            ++pos;
+        }
+    }
+    return specials;
+}
+
+int main(int argc, char** argv)
+{
+    std::string path = argc > 1 ? argv[1] : "../test_files/complex_example.md";
+    size_t scale = argc > 2 ? std::stoul(argv[2]) : 256;
+    size_t repetitions = argc > 3 ? std::stoul(argv[3]) : 5;
+
+    std::ifstream file(path);
+    if (file.fail())
+    {
+        std::cerr << "Unable to open " << path << std::endl;
+        return 1;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string text;
+    for (size_t i = 0; i < scale; ++i)
+        text += buffer.str();
+
+    // InputSource reads from a file, so the scaled document is written out first
+    std::string scaled_path = "scanner_bench_input.md";
+    std::ofstream(scaled_path) << text;
+    InputSource input;
+    if (!input.open(scaled_path))
+    {
+        std::cerr << "Unable to open " << scaled_path << std::endl;
+        return 1;
+    }
+    std::cout << "Input: " << path << " x" << scale << " = " << text.size() << " bytes" << std::endl;
+
+    size_t expected = count_specials(text_scanner::find_special_scalar, text);
+    auto bench_kernel = [&](const std::string& name, text_scanner::ScanFunction scan) {
+        if (count_specials(scan, text) != expected)
+        {
+            std::cerr << name << " disagrees with the scalar scanner" << std::endl;
+            std::exit(1);
+        }
+        report(name, text.size(), min_cycles(repetitions, [&] { count_specials(scan, text); }));
+    };
+    bench_kernel("scanner scalar", text_scanner::find_special_scalar);
+#ifdef TEXT_SCANNER_X86
+    bench_kernel("scanner sse2", text_scanner::find_special_sse2);
+    if (__builtin_cpu_supports("avx2"))
+        bench_kernel("scanner avx2", text_scanner::find_special_avx2);
+#endif
+
+    Logger logger;
+    for (bool fast_skip : {false, true})
+    {
+        unsigned long long cycles = min_cycles(repetitions, [&] {
+            Md_Parser parser(input, &logger);
+            parser.set_fast_skip(fast_skip);
+            parser.parse_document();
+        });
+        report(fast_skip ? "parse with fast skip (after)" : "parse byte by byte (before)", text.size(), cycles);
+    }
+    std::remove(scaled_path.c_str());
+}
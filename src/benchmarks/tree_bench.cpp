@@ -0,0 +1,241 @@
+/**
+ * @file tree_bench.cpp
+ * @brief Compares the tree of nodes with the FlatTree (see flat_tree.hpp): building, traversing and rendering,
+ * and rendering the FlatTree saved into a tree file and mapped back (see FlatTreeFile).
+ *
+ * Usage: tree_bench [markdown-file] [megabytes] [repetitions]
+ *
+ * The input (defaulting to ../test_files/complex_example.md) is concatenated until it is at least
+ * `megabytes` MB large (100 by default). Both trees are built from it, traversed (every node is visited
+ * and the text of its content is summed up) and rendered into HTML. The flat tree is also saved, mapped
+ * back and rendered from the mapping, which is what a render skipping the parser costs. The three HTML
+ * outputs have to be equal.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <cstdio>
+
+#include "../error_handler.hpp"
+#include "../flat_tree.hpp"
+#include "../flat_tree_file.hpp"
+#include "../parsing/input_source.hpp"
+#include "../parsing/markdown_parser.hpp"
+#include "../building/html_constructor.hpp"
+#include "../building/output_sink.hpp"
+
+/**
+ * @brief Runs `body` `repetitions` times and returns the fewest milliseconds a single run took.
+ */
+template <typename Body>
+static double min_millis(size_t repetitions, Body&& body)
+{
+    double best = 1e300;
+    for (size_t i = 0; i < repetitions; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+        best = std::min(best, took.count());
+    }
+    return best;
+}
+
+static void report(const std::string& name, double millis)
+{
+    std::cout << name << ": " << millis << " ms" << std::endl;
+}
+
+/**
+ * @struct CountingVisitor
+ * @brief Visits every node of a tree of nodes, counting them and the characters of their content.
+ */
+struct CountingVisitor : public NodeVisitor
+{
+    size_t nodes = 0;
+    size_t characters = 0;
+
+    void visit(Node& node, size_t indent) override
+    {
+        ++nodes;
+        for (auto&& child : node.children)
+            child->accept(*this, indent + 1);
+    }
+    void visit(ContentNode& node, size_t) override
+    {
+        ++nodes;
+        characters += node.content.view().size();
+    }
+    void visit(ImageNode& node, size_t) override
+    {
+        ++nodes;
+        characters += node.alt.size();
+    }
+    void visit(HyperlinkNode& node, size_t) override
+    {
+        ++nodes;
+        characters += node.displayed.size();
+    }
+};
+
+/**
+ * @brief The flat counterpart of CountingVisitor, a single pass over the arrays.
+ */
+static std::pair<size_t, size_t> count_flat(const FlatTree& tree)
+{
+    size_t characters = 0;
+    for (NodeIndex i = 0; i < tree.size(); ++i)
+    {
+        if (tree.payloads[i] == NO_NODE)
+            continue;
+        if (tree.elements[i] == ElementType::ImageType || tree.elements[i] == ElementType::Hypertext)
+            characters += tree.links[tree.payloads[i]].text.size();
+        else
+            characters += tree.contents[tree.payloads[i]].view().size();
+    }
+    return {tree.size(), characters};
+}
+
+/**
+ * @brief Renders a document into `path` the way main does, the styles go to a scratch file.
+ */
+static void render(const std::string& path, const std::function<void(HTML_Builder&, OutputSink&)>& build)
+{
+    Logger logger;
+    OutputSink output;
+    OutputSink styles;
+    output.open(path);
+    styles.open("tree_bench_styles.css");
+    HTML_Builder builder(&logger);
+    builder.set_css_builder(styles);
+    build(builder, output);
+    output.close();
+    styles.close();
+}
+
+static std::string read_file(const std::string& path)
+{
+    std::ifstream file(path);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+int main(int argc, char** argv)
+{
+    std::string path = argc > 1 ? argv[1] : "../test_files/complex_example.md";
+    size_t megabytes = argc > 2 ? std::stoul(argv[2]) : 100;
+    size_t repetitions = argc > 3 ? std::stoul(argv[3]) : 3;
+
+    std::ifstream file(path);
+    if (file.fail())
+    {
+        std::cerr << "Unable to open " << path << std::endl;
+        return 1;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    // the copies are separated by empty lines, so that no block continues into the next copy
+    std::string piece = buffer.str() + "\n\n\n";
+    std::string text;
+    while (text.size() < megabytes * 1000000)
+        text += piece;
+
+    // InputSource reads from a file, so the synthetic document is written out first
+    std::string scaled_path = "tree_bench_input.md";
+    std::ofstream(scaled_path) << text;
+    text.clear();
+    text.shrink_to_fit();
+    InputSource input;
+    if (!input.open(scaled_path))
+    {
+        std::cerr << "Unable to open " << scaled_path << std::endl;
+        return 1;
+    }
+    std::cout << "Input: " << path << " repeated up to " << input.view().size() << " bytes" << std::endl;
+
+    Logger logger;
+    size_t node_count = 0;
+    size_t node_characters = 0;
+    {
+        TreeRoot root;
+        report("build node tree", min_millis(repetitions, [&] {
+            root = nullptr;
+            root = Md_Parser(input, &logger).parse_document();
+        }));
+        report("traverse node tree", min_millis(repetitions, [&] {
+            CountingVisitor visitor;
+            for (auto&& child : root->children)
+                child->accept(visitor, 0);
+            node_count = visitor.nodes + 1;
+            node_characters = visitor.characters;
+        }));
+        report("render node tree", min_millis(1, [&] {
+            render("tree_bench_nodes.html", [&](HTML_Builder& builder, OutputSink& output) {
+                builder.build_document(output, "styles.css", std::move(root));
+            });
+        }));
+    }
+
+    size_t flat_count = 0;
+    size_t flat_characters = 0;
+    {
+        FlatTree tree;
+        report("build flat tree", min_millis(repetitions, [&] {
+            tree = FlatTree();
+            tree = Md_Parser(input, &logger).parse_flat_document();
+        }));
+        report("traverse flat tree", min_millis(repetitions, [&] {
+            std::tie(flat_count, flat_characters) = count_flat(tree);
+        }));
+        report("render flat tree", min_millis(1, [&] {
+            render("tree_bench_flat.html", [&](HTML_Builder& builder, OutputSink& output) {
+                builder.build_document(output, "styles.css", tree);
+            });
+        }));
+        report("save flat tree", min_millis(repetitions, [&] {
+            OutputSink tree_stream;
+            tree_stream.open("tree_bench_tree.mdt");
+            FlatTreeFile::write(tree, tree_stream);
+            tree_stream.close();
+        }));
+    }
+    {
+        FlatTreeFile tree_file;
+        bool mapped = false;
+        report("map tree file", min_millis(repetitions, [&] {
+            mapped = tree_file.open("tree_bench_tree.mdt");
+        }));
+        if (!mapped)
+        {
+            std::cerr << "Unable to map the saved tree" << std::endl;
+            return 1;
+        }
+        report("render mapped tree", min_millis(repetitions, [&] {
+            render("tree_bench_mapped.html", [&](HTML_Builder& builder, OutputSink& output) {
+                builder.build_document(output, "styles.css", tree_file.tree());
+            });
+        }));
+    }
+
+    std::cout << "Nodes: " << node_count << ", content characters: " << node_characters << std::endl;
+    bool same = node_count == flat_count && node_characters == flat_characters
+        && read_file("tree_bench_nodes.html") == read_file("tree_bench_flat.html")
+        && read_file("tree_bench_flat.html") == read_file("tree_bench_mapped.html");
+    std::remove("tree_bench_nodes.html");
+    std::remove("tree_bench_flat.html");
+    std::remove("tree_bench_mapped.html");
+    std::remove("tree_bench_tree.mdt");
+    std::remove("tree_bench_styles.css");
+    std::remove(scaled_path.c_str());
+    if (!same)
+    {
+        std::cerr << "The flat tree differs from the tree of nodes" << std::endl;
+        return 1;
+    }
+}
@@ -2,10 +2,12 @@
 #define _CSS_CONSTRUCTOR_HPP
 
 #include <string>
-#include <fstream>
 #include <set>
+#include <vector>
 #include <unordered_map>
 #include "../node.hpp"
+#include "output_sink.hpp"
+#include "../stats.hpp"
 
 /**
  * @class CSS_Constructor
@@ -28,11 +30,19 @@ public:
     /**
      * @brief Constructs a `CSS_Constructor` instance.
      * 
-     * @param stream A reference to the output stream where the CSS file will be written.
+     * @param stream A reference to the output sink where the CSS file will be written.
      */
-    CSS_Constructor(std::ofstream& stream)
+    CSS_Constructor(OutputSink& stream)
     : used_attributes(std::set<Attribute>()),
-      styles_stream(stream) {}
+      styles_stream(&stream) {}
+
+    /**
+     * @brief Constructs a `CSS_Constructor` which only collects the used attributes without writing anything,
+     * e.g. for a stylesheet shared by several documents (see `get_used_attributes`).
+     */
+    CSS_Constructor()
+    : used_attributes(std::set<Attribute>()),
+      styles_stream(nullptr) {}
 
     /**
      * @brief Adds a CSS class for a given attribute.
@@ -49,7 +59,35 @@ public:
             return;
 
         used_attributes.emplace(attr);
-        setup_css_class(attr);
+        attributes_in_order.push_back(attr);
+        PhaseTimer timer(stats, Styles);
+        if (styles_stream != nullptr)
+            setup_css_class(attr);
+    }
+
+    /**
+     * @brief Collects the time spent writing CSS into `stats` (see Stats). Off by default.
+     */
+    void set_stats(Stats* stats)
+    {
+        this->stats = stats;
+    }
+
+    /**
+     * @brief Returns the attributes a CSS class has been added for.
+     */
+    const std::set<Attribute>& get_used_attributes() const
+    {
+        return used_attributes;
+    }
+
+    /**
+     * @brief Returns the attributes a CSS class has been added for, in the order they were added, i.e. the order
+     * of the classes in the CSS file.
+     */
+    const std::vector<Attribute>& get_attributes_in_order() const
+    {
+        return attributes_in_order;
     }
 
     /**
@@ -59,15 +97,20 @@ public:
      */
     void create_default_styling()
     {
-        styles_stream << "body {" << std::endl;
-        styles_stream << "margin: 2rem auto;" << std::endl;
-        styles_stream << "width: 80%;" << std::endl;
-        styles_stream << '}' << std::endl;
+        if (styles_stream == nullptr)
+            return;
+        PhaseTimer timer(stats, Styles);
+        *styles_stream << "body {\n";
+        *styles_stream << "margin: 2rem auto;\n";
+        *styles_stream << "width: 80%;\n";
+        *styles_stream << "}\n";
     }
 
 private:
     std::set<Attribute> used_attributes; /**< A set of attributes that have already been added as CSS classes. */
-    std::ofstream& styles_stream; /**< The output stream for writing the CSS file. */
+    std::vector<Attribute> attributes_in_order; /**< The same attributes, in the order they were added. */
+    OutputSink* styles_stream; /**< The output sink for writing the CSS file, null if only collecting. */
+    Stats* stats = nullptr; /**< Where to collect timing, null if not collecting. */
 
     /**
      * @brief Maps attributes to their corresponding CSS styles.
@@ -103,11 +146,11 @@ private:
      */
     void setup_css_class(Attribute attr)
     {
-        styles_stream << '.' << attr_enum_to_name[attr] << " {" << std::endl;
+        *styles_stream << '.' << attr_enum_to_name[attr] << " {\n";
         auto attr_it = attr_to_css.find(attr);
         if (attr_it == attr_to_css.end()) { throw std::runtime_error("unknown attribute"); }
 
-        styles_stream << attr_it->second << std::endl << '}' << std::endl;
+        *styles_stream << attr_it->second << '\n' << "}\n";
     }
 };
 
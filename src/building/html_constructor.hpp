@@ -3,12 +3,17 @@
 
 #define ELEMENT_INDENTATION 4
 
-#include <fstream>
 #include <iostream>
 #include <memory>
+#include <set>
 #include "../node.hpp"
+#include "../node_arena.hpp"
+#include "../flat_tree.hpp"
+#include "../flat_tree_file.hpp"
 #include "css_constructor.hpp"
 #include "html_visitor.hpp"
+#include "html_renderer.hpp"
+#include "output_sink.hpp"
 #include "../error_handler.hpp"
 #include "builder_interface.hpp"
 
@@ -49,8 +54,8 @@ public:
      * Visitor design pattern (via `HTML_Visitor`) and generates the HTML content. It also
      * initializes the `CSS_Constructor` to create the associated CSS file.
      * 
-     * @param output_stream The output stream for the HTML file.
-     * @param styles_stream The output stream for the CSS file.
+     * @param output_stream The output sink for the HTML file.
+     * @param styles_stream The output sink for the CSS file.
      * @param stylesheet_name The name of the CSS file to link in the HTML document.
      * @param root The root node of the parsing tree.
      * 
@@ -60,27 +65,115 @@ public:
      * @see HTML_Visitor
      */
     virtual void build_document(
-        std::ofstream& output_stream,
+        OutputSink& output_stream,
         const std::string& stylesheet_name,
-        std::unique_ptr<Node> root) override
+        TreeRoot root) override
     {
         if (root->element != ElementType::DOCSTART) {
-            logger->log_error("Document is not starting with DOCTYPE. This is an error on our side.");
+            LOG_ERROR(logger, "Document is not starting with DOCTYPE. This is an error on our side.");
             throw std::runtime_error("doc not starting with DOCTYPE");
         }
-        css_builder->create_default_styling();
-        
-        output_stream << '<' << element_to_html_name[ElementType::DOCSTART] << '>' << std::endl;
-
-        setup_html_meta_tags(output_stream, stylesheet_name);
-        output_stream << "<body>" << std::endl;
+        PhaseTimer timer(stats, Render);
+        begin_document(output_stream, stylesheet_name);
         
         HTML_Visitor visitor(output_stream, css_builder.get(), ELEMENT_INDENTATION);
         for (auto&& child : root->children)
         {
             child->accept(visitor, 0); 
         }
-        output_stream << std::endl << std::endl << "</body>" << std::endl;
+        output_stream << "\n\n</body>\n";
+    }
+
+    /**
+     * @brief Builds an HTML document from a `FlatTree`, which is traversed linearly (see HTML_Visitor::visit_flat).
+     * The output is the same as for the equivalent tree of nodes.
+     * 
+     * @param output_stream The output sink for the HTML file.
+     * @param stylesheet_name The name of the CSS file to link in the HTML document.
+     * @param tree The flat parsing tree.
+     */
+    void build_document(
+        OutputSink& output_stream,
+        const std::string& stylesheet_name,
+        const FlatTree& tree)
+    {
+        build_flat_document(output_stream, stylesheet_name, tree);
+    }
+
+    /**
+     * @brief Builds an HTML document from a tree file mapped into memory (see FlatTreeFile), without parsing.
+     * The output is the same as for the FlatTree which was saved.
+     * 
+     * @param output_stream The output sink for the HTML file.
+     * @param stylesheet_name The name of the CSS file to link in the HTML document.
+     * @param tree The mapped parsing tree.
+     */
+    void build_document(
+        OutputSink& output_stream,
+        const std::string& stylesheet_name,
+        const FlatTreeView& tree)
+    {
+        build_flat_document(output_stream, stylesheet_name, tree);
+    }
+
+    /**
+     * @brief Starts building a document block by block (see Md_Parser::set_block_handler), writing everything
+     * preceding the body's content.
+     * 
+     * @param output_stream The output sink for the HTML file. It has to stay open until `end_stream`.
+     * @param stylesheet_name The name of the CSS file to link in the HTML document.
+     */
+    void begin_stream(OutputSink& output_stream, const std::string& stylesheet_name)
+    {
+        PhaseTimer timer(stats, Render);
+        begin_document(output_stream, stylesheet_name);
+        stream_sink = &output_stream;
+        stream_visitor = std::make_unique<HTML_Visitor>(output_stream, css_builder.get(), ELEMENT_INDENTATION);
+    }
+
+    /**
+     * @brief Writes a top-level block of the document started by `begin_stream`. The output is the same as
+     * if the block were visited as a child of the root by `build_document`.
+     * 
+     * @param block The block, a child of the DOCSTART root.
+     */
+    void stream_block(Node& block)
+    {
+        PhaseTimer timer(stats, Render);
+        block.accept(*stream_visitor, 0);
+    }
+
+    /**
+     * @brief Starts rendering a document straight from the parser's tokens, without building a tree
+     * (see Md_Parser::set_sink), writing everything preceding the body's content. The output is the same
+     * as `build_document`'s.
+     * 
+     * @param output_stream The output sink for the HTML file. It has to stay open until `end_stream`.
+     * @param stylesheet_name The name of the CSS file to link in the HTML document.
+     * @return The sink to give to the parser, valid until `end_stream`.
+     * 
+     * @see HTML_Renderer
+     */
+    TokenSink& begin_render(OutputSink& output_stream, const std::string& stylesheet_name)
+    {
+        PhaseTimer timer(stats, Render);
+        begin_document(output_stream, stylesheet_name);
+        stream_sink = &output_stream;
+        stream_renderer = std::make_unique<HTML_Renderer>(output_stream, css_builder.get(), ELEMENT_INDENTATION);
+        return *stream_renderer;
+    }
+
+    /**
+     * @brief Finishes a document started by `begin_stream` or `begin_render`. The CSS file is complete
+     * from then on as well.
+     */
+    void end_stream()
+    {
+        PhaseTimer timer(stats, Render);
+        *stream_sink << "\n\n</body>\n";
+        stream_visitor = nullptr;
+        stream_renderer = nullptr;
+        stream_sink = nullptr;
     }
 
     /**
@@ -89,11 +182,51 @@ public:
      * This method initializes the `CSS_Constructor` instance that will be used to generate
      * the CSS file. It should be called before building the document.
      * 
-     * @param styles_stream The output stream for the CSS file.
+     * @param styles_stream The output sink for the CSS file.
      */
-    void set_css_builder(std::ofstream& styles_stream)
+    void set_css_builder(OutputSink& styles_stream)
     {
         this->css_builder = std::make_unique<CSS_Constructor>(styles_stream);
+        css_builder->set_stats(stats);
+    }
+
+    /**
+     * @brief Sets a CSS builder which writes no CSS file but only collects the classes used by the documents
+     * built, e.g. for a stylesheet shared by several documents.
+     * 
+     * @see get_used_attributes
+     */
+    void set_css_builder()
+    {
+        this->css_builder = std::make_unique<CSS_Constructor>();
+        css_builder->set_stats(stats);
+    }
+
+    /**
+     * @brief Collects the time spent rendering HTML and CSS into `stats` (see Stats), null to stop collecting.
+     */
+    void set_stats(Stats* stats)
+    {
+        this->stats = stats;
+        if (css_builder != nullptr)
+            css_builder->set_stats(stats);
+    }
+
+    /**
+     * @brief Returns the attributes used as CSS classes in the documents built so far.
+     */
+    const std::set<Attribute>& get_used_attributes() const
+    {
+        return css_builder->get_used_attributes();
+    }
+
+    /**
+     * @brief Returns the attributes used as CSS classes in the documents built so far, in the order
+     * of their classes in the CSS file.
+     */
+    const std::vector<Attribute>& get_attributes_in_order() const
+    {
+        return css_builder->get_attributes_in_order();
     }
 
 private:
@@ -101,36 +234,55 @@ private:
     bool prev_token_content; /**< Tracks whether the previous token was content. */
     size_t prev_token_indent; /**< Tracks the indentation level of the previous token. */
     Logger* logger; /**< Pointer to the Logger instance for logging. */
+    std::unique_ptr<HTML_Visitor> stream_visitor; /**< The visitor of a document built block by block. */
+    std::unique_ptr<HTML_Renderer> stream_renderer; /**< The renderer of a document rendered from tokens. */
+    OutputSink* stream_sink = nullptr; /**< The output sink of a document built block by block or rendered from tokens. */
+    Stats* stats = nullptr; /**< Where to collect timing, null if not collecting. */
 
     /**
-     * @brief Fills the output stream with spaces for indentation.
-     * 
-     * @param stream The output stream to write to.
-     * @param indent The number of spaces to write.
+     * @brief Builds an HTML document from a FlatTree or a FlatTreeView.
      */
-    
-    void fill_in_indenting(std::ofstream& stream, const size_t& indent)
+    template <typename Tree>
+    void build_flat_document(OutputSink& output_stream, const std::string& stylesheet_name, const Tree& tree)
     {
-        for (size_t i = 0; i < indent; ++i) {stream << ' ';}
+        PhaseTimer timer(stats, Render);
+        begin_document(output_stream, stylesheet_name);
+
+        HTML_Visitor visitor(output_stream, css_builder.get(), ELEMENT_INDENTATION);
+        visitor.visit_flat(tree);
+        output_stream << "\n\n</body>\n";
+    }
+
+    /**
+     * @brief Creates the default styling and writes everything preceding the body's content.
+     */
+    void begin_document(OutputSink& output_stream, const std::string& stylesheet_name)
+    {
+        css_builder->create_default_styling();
+        
+        output_stream << '<' << element_to_html_name[ElementType::DOCSTART] << ">\n";
+
+        setup_html_meta_tags(output_stream, stylesheet_name);
+        output_stream << "<body>\n";
     }
 
     /**
      * @brief Sets up the meta tags for the HTML document.
      * 
-     * @param stream The output stream for the HTML file.
+     * @param stream The output sink for the HTML file.
      * @param stylesheet_name The name of the CSS file to link in the HTML document.
      */
-    void setup_html_meta_tags(std::ofstream& stream, const std::string& stylesheet_name)
+    void setup_html_meta_tags(OutputSink& stream, const std::string& stylesheet_name)
     {
         size_t indent = 1;
-        stream << "<head>" << std::endl;
-        fill_in_indenting(stream, indent);
-        stream << "<meta charset=\"utf-8\">" << std::endl;
-        fill_in_indenting(stream, indent);
-        stream << "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">" << std::endl;
-        fill_in_indenting(stream, indent);
-        stream << "<link rel=\"stylesheet\" href=\"" << stylesheet_name << "\">" << std::endl;
-        stream << "</head>" << std::endl;
+        stream << "<head>\n";
+        stream.indent(indent);
+        stream << "<meta charset=\"utf-8\">\n";
+        stream.indent(indent);
+        stream << "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n";
+        stream.indent(indent);
+        stream << "<link rel=\"stylesheet\" href=\"" << stylesheet_name << "\">\n";
+        stream << "</head>\n";
     }
 };
 
@@ -0,0 +1,212 @@
+/**
+ * @file html_renderer.hpp
+ * @brief Rendering HTML straight from the parser's tokens, without a parsing tree.
+ */
+
+#ifndef _HTML_RENDERER_HPP
+#define _HTML_RENDERER_HPP
+
+#include <vector>
+#include <stdexcept>
+#include "../token.hpp"
+#include "../node.hpp"
+#include "../parsing_tree/token_sink.hpp"
+#include "css_constructor.hpp"
+#include "output_sink.hpp"
+
+/**
+ * @class HTML_Renderer
+ * @brief A `TokenSink` writing the HTML of every token as it arrives. The output is the same as what
+ * `HTML_Visitor` writes for the tree built from the same tokens.
+ *
+ * Only the stack of open elements is kept. The attributes of an element follow its open token, so its
+ * opening tag is written together with the next token. The children of images, hyperlinks and horizontal
+ * lines are skipped, as `HTML_Visitor` skips them. Tables arrive as subtrees replayed once they are
+ * complete (see TokenSink::append_subtree), so they are the only part of the document held in memory.
+ *
+ * @see HTML_Visitor
+ * @see HTML_Builder::begin_render
+ */
+class HTML_Renderer : public TokenSink
+{
+public:
+    /**
+     * @param stream The output sink to write the HTML to.
+     * @param css_builder The CSS builder collecting the classes used.
+     * @param indent The number of spaces each nesting level is indented by.
+     */
+    HTML_Renderer(OutputSink& stream, CSS_Constructor* css_builder, size_t indent)
+    : stream(stream),
+      css_builder(css_builder),
+      SPACE_INDENT(indent) {}
+
+    void consume_token(Token token) override
+    {
+        if (skipped_depth != 0)
+        {
+            if (token.type == TokenType::OpenToken)
+                ++skipped_depth;
+            else if (token.type == TokenType::CloseToken)
+                --skipped_depth;
+            return;
+        }
+        write_pending_tag();
+        switch (token.type)
+        {
+        case TokenType::OpenToken:
+            open(token);
+            break;
+        case TokenType::CloseToken:
+            close(token.element);
+            break;
+        case TokenType::ContentToken:
+            write_content(token.text);
+            break;
+        default:
+            break;
+        }
+    }
+
+    /**
+     * @throws std::runtime_error If the opening tag of the innermost element has already been written.
+     */
+    void add_attribute(Attribute attribute) override
+    {
+        if (skipped_depth != 0 || open_elements.empty())
+            return;
+        if (!tag_pending)
+            throw std::runtime_error("an attribute does not directly follow the element it belongs to");
+        pending_attributes.push_back(attribute);
+    }
+
+    void end_document() override
+    {
+        write_pending_tag();
+    }
+
+private:
+    /**
+     * @struct OpenElement
+     * @brief An element whose closing tag is still to be written.
+     */
+    struct OpenElement
+    {
+        ElementType element;
+        bool block_code;  // whether it is a code block with Block as its first attribute, written inside <pre>
+    };
+
+    OutputSink& stream;
+    CSS_Constructor* css_builder;
+    size_t SPACE_INDENT;
+    std::vector<OpenElement> open_elements;
+    std::vector<Attribute> pending_attributes;  // of the innermost element, while its opening tag is pending
+    bool tag_pending = false;  // whether the opening tag of the innermost element is still to be written
+    size_t skipped_depth = 0;  // the nesting depth inside an element whose children are not rendered
+    bool prev_token_content = false;
+    size_t prev_token_indent = 0;
+
+    size_t indent_of_children() const
+    {
+        return open_elements.size() * SPACE_INDENT;
+    }
+
+    void open(const Token& token)
+    {
+        prev_token_content = false;
+        size_t indent = indent_of_children();
+        if (token.element == ElementType::ImageType && token.link != nullptr)
+        {
+            stream << '\n';
+            stream.indent(indent);
+            stream << "<img src=\"" << token.text << "\" alt=\"" << token.link->alt << "\" title=\"" << token.link->title << "\""" class=\"ImageAttr\"" << "/>";
+            css_builder->add_css_attr_class(Attribute::ImageAttr);
+            skipped_depth = 1;
+            return;
+        }
+        if (token.element == ElementType::Hypertext && token.link != nullptr)
+        {
+            stream << '\n';
+            stream.indent(indent);
+            stream << "<a href=\"" << token.text << "\" title=\"" << token.link->title << "\">" << token.link->alt << "</a>";
+            skipped_depth = 1;
+            return;
+        }
+
+        auto it = element_to_html_name.find(token.element);
+        if (it == element_to_html_name.end()) {throw std::runtime_error("unknown element");}
+        if (token.element == ElementType::Horizontalline)
+        {
+            stream << '\n';
+            stream.indent(indent);
+            stream << '<' << it->second << "/>";
+            skipped_depth = 1;
+            return;
+        }
+        open_elements.push_back(OpenElement{token.element, false});
+        tag_pending = true;
+    }
+
+    /**
+     * @brief Writes the opening tag of the innermost element, with its attributes as CSS classes.
+     */
+    void write_pending_tag()
+    {
+        if (!tag_pending)
+            return;
+        tag_pending = false;
+        OpenElement& element = open_elements.back();
+        stream << '\n';
+        stream.indent(indent_of_children() - SPACE_INDENT);
+        stream << '<' << element_to_html_name[element.element];
+        if (!pending_attributes.empty())
+        {
+            stream << " class= \"";
+            bool first = true;
+            for (Attribute attr : pending_attributes)
+            {
+                if (first)
+                    first = false;
+                else
+                    stream << ' ';
+                stream << attr_enum_to_name[attr];
+
+                css_builder->add_css_attr_class(attr);
+            }
+            stream << "\"";
+        }
+
+        stream << '>';
+        element.block_code = element.element == ElementType::Codeblock
+            && !pending_attributes.empty() && pending_attributes.front() == Attribute::Block;
+        if (element.block_code)
+            stream << "<pre>";
+        pending_attributes.clear();
+    }
+
+    void close(ElementType element)
+    {
+        if (open_elements.empty() || open_elements.back().element != element)
+            throw std::runtime_error("incorrectly parsed tree");
+        stream << '\n';
+        stream.indent(indent_of_children() - SPACE_INDENT);
+        if (open_elements.back().block_code)
+            stream << "</pre>";
+        stream << "</" << element_to_html_name[element] << '>';
+        open_elements.pop_back();
+    }
+
+    void write_content(std::string_view text)
+    {
+        size_t indent = indent_of_children();
+        if (!prev_token_content || prev_token_indent != indent)
+        {
+            prev_token_content = true;
+            prev_token_indent = indent;
+            stream << '\n';
+            stream.indent(indent);
+        }
+        stream << text;
+    }
+};
+
+#endif
@@ -1,9 +1,11 @@
 #ifndef __HTML_VISITOR_HPP
 #define __HTML_VISITOR_HPP
 
-#include <fstream>
+#include <vector>
 #include "../node.hpp"
+#include "../flat_tree.hpp"
 #include "css_constructor.hpp"
+#include "output_sink.hpp"
 
 
 /**
@@ -28,11 +30,11 @@ class HTML_Visitor : public NodeVisitor {
         /**
          * @brief Constructs an `HTML_Visitor` object.
          * 
-         * @param stream The output stream to write the generated HTML to.
+         * @param stream The output sink to write the generated HTML to.
          * @param css_builder Pointer to a `CSS_Constructor` for managing CSS classes.
          * @param indent The initial indentation level for the HTML output.
          */
-        HTML_Visitor(std::ofstream& stream, CSS_Constructor* css_builder, const size_t& indent)
+        HTML_Visitor(OutputSink& stream, CSS_Constructor* css_builder, const size_t& indent)
         : stream(stream),
           css_builder(css_builder),
           prev_token_content(false),
@@ -52,8 +54,8 @@ class HTML_Visitor : public NodeVisitor {
             prev_token_content = false;
             auto it = element_to_html_name.find(node.element);
             if (it == element_to_html_name.end()) {throw std::runtime_error("unknown element");}
-            stream << std::endl;
-            fill_in_indenting(stream, indent);
+            stream << '\n';
+            stream.indent(indent);
             stream << '<' << it->second;
             if (node.element == ElementType::Horizontalline)
             {
@@ -88,8 +90,8 @@ class HTML_Visitor : public NodeVisitor {
                 child->accept(*this, indent + SPACE_INDENT);
             }
 
-            stream << std::endl;
-            fill_in_indenting(stream, indent);
+            stream << '\n';
+            stream.indent(indent);
             if (node.element == ElementType::Codeblock && node.attributes[0] == Attribute::Block)
                 stream << "</pre>";
             stream << "</" << it->second << '>';
@@ -107,10 +109,10 @@ class HTML_Visitor : public NodeVisitor {
             {
                 prev_token_content = true;
                 prev_token_indent = indent;
-                stream << std::endl;
-                fill_in_indenting(stream, indent);
+                stream << '\n';
+                stream.indent(indent);
             }
-            stream << node.content;
+            stream << node.content.view();
         }
 
         /**
@@ -122,8 +124,8 @@ class HTML_Visitor : public NodeVisitor {
         void visit(ImageNode& node, size_t indent) override 
         {
             prev_token_content = false;
-            stream << std::endl;
-            fill_in_indenting(stream, indent);
+            stream << '\n';
+            stream.indent(indent);
             stream << "<img src=\"" << node.src << "\" alt=\"" << node.alt << "\" title=\"" << node.title << "\""" class=\"ImageAttr\"" << "/>";
             css_builder->add_css_attr_class(Attribute::ImageAttr);
         }
@@ -137,21 +139,140 @@ class HTML_Visitor : public NodeVisitor {
         void visit(HyperlinkNode& node, size_t indent) override
         {
             prev_token_content = false;
-            stream << std::endl;
-            fill_in_indenting(stream, indent);
+            stream << '\n';
+            stream.indent(indent);
             stream << "<a href=\"" << node.href << "\" title=\"" << node.title << "\">" << node.displayed << "</a>";
         }
+
+        /**
+         * @brief Generates the HTML of a whole `FlatTree` or `FlatTreeView` (without the DOCSTART root) in one linear pass.
+         * 
+         * The output is the same as visiting the children of the root of the equivalent tree of nodes. Nodes are
+         * stored in document order, so the closing tags are emitted when a node at the same or a lower depth
+         * comes up; the indentation follows from the depth.
+         * 
+         * @param tree The tree to write.
+         * 
+         * @throws std::runtime_error If a node's element type is unknown or a node other than the root has depth 0.
+         */
+        template <typename Tree>
+        void visit_flat(const Tree& tree)
+        {
+            std::vector<NodeIndex> open;  // the elements whose closing tags are pending, innermost last
+            NodeIndex i = 1;
+            while (i < tree.size())
+            {
+                uint32_t depth = tree.depths[i];
+                if (depth == 0) {throw std::runtime_error("incorrectly parsed tree");}
+                while (!open.empty() && tree.depths[open.back()] >= depth)
+                {
+                    close_flat_element(tree, open.back());
+                    open.pop_back();
+                }
+                size_t indent = (depth - 1) * SPACE_INDENT;
+                ElementType element = tree.elements[i];
+
+                if (tree.payloads[i] != NO_NODE && (element == ElementType::ImageType || element == ElementType::Hypertext))
+                {
+                    const auto& link = tree.links[tree.payloads[i]];
+                    prev_token_content = false;
+                    stream << '\n';
+                    stream.indent(indent);
+                    if (element == ElementType::ImageType)
+                    {
+                        stream << "<img src=\"" << link.target << "\" alt=\"" << link.text << "\" title=\"" << link.title << "\""" class=\"ImageAttr\"" << "/>";
+                        css_builder->add_css_attr_class(Attribute::ImageAttr);
+                    }
+                    else
+                        stream << "<a href=\"" << link.target << "\" title=\"" << link.title << "\">" << link.text << "</a>";
+                    i = tree.subtree_end(i);
+                    continue;
+                }
+                if (tree.payloads[i] != NO_NODE)
+                {
+                    if (!prev_token_content || prev_token_indent != indent)
+                    {
+                        prev_token_content = true;
+                        prev_token_indent = indent;
+                        stream << '\n';
+                        stream.indent(indent);
+                    }
+                    stream << tree.contents[tree.payloads[i]].view();
+                    i = tree.subtree_end(i);
+                    continue;
+                }
+
+                prev_token_content = false;
+                auto it = element_to_html_name.find(element);
+                if (it == element_to_html_name.end()) {throw std::runtime_error("unknown element");}
+                stream << '\n';
+                stream.indent(indent);
+                stream << '<' << it->second;
+                if (element == ElementType::Horizontalline)
+                {
+                    stream << "/>";
+                    i = tree.subtree_end(i);
+                    continue;
+                }
+
+                AttributeMask mask = tree.attributes[i];
+                if (mask != 0)
+                {
+                    stream << " class= \"";
+                    bool first = true;
+                    for (uint32_t attr = 0; mask >> attr != 0; ++attr)
+                    {
+                        if (!((mask >> attr) & 1))
+                            continue;
+                        if (first)
+                            first = false;
+                        else 
+                            stream << ' ';
+                        stream << attr_enum_to_name[attr];
+
+                        css_builder->add_css_attr_class(static_cast<Attribute>(attr));
+                    }
+                    stream << "\"";
+                }
+
+                stream << '>';
+                if (is_block_code(tree, i))
+                    stream << "<pre>";
+                open.push_back(i);
+                ++i;
+            }
+            while (!open.empty())
+            {
+                close_flat_element(tree, open.back());
+                open.pop_back();
+            }
+        }
     
     private:
-        std::ofstream& stream;
+        OutputSink& stream;
         CSS_Constructor* css_builder;
         bool prev_token_content;
         size_t prev_token_indent;
         size_t SPACE_INDENT;
 
-        void fill_in_indenting(std::ofstream& stream, size_t indent)
+        /**
+         * @brief Returns whether a node of a FlatTree is a code block with Block as its first attribute.
+         */
+        template <typename Tree>
+        static bool is_block_code(const Tree& tree, NodeIndex node)
+        {
+            AttributeMask mask = tree.attributes[node];
+            return tree.elements[node] == ElementType::Codeblock && (mask & -mask) == (AttributeMask(1) << Attribute::Block);
+        }
+
+        template <typename Tree>
+        void close_flat_element(const Tree& tree, NodeIndex node)
         {
-            for (size_t i = 0; i < indent; ++i) {stream << ' ';}
+            stream << '\n';
+            stream.indent((tree.depths[node] - 1) * SPACE_INDENT);
+            if (is_block_code(tree, node))
+                stream << "</pre>";
+            stream << "</" << element_to_html_name[tree.elements[node]] << '>';
         }
 };
 
@@ -0,0 +1,256 @@
+/**
+ * @file output_sink.hpp
+ * @brief Buffered, write-only access to an output file.
+ */
+
+#ifndef _OUTPUT_SINK_HPP
+#define _OUTPUT_SINK_HPP
+
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include "../alloc_accounting.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define OUTPUT_SINK_POSIX 1
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
+/**
+ * @brief The amount of buffered output which triggers a write to the file.
+ */
+#ifndef OUTPUT_SINK_FLUSH_SIZE
+#define OUTPUT_SINK_FLUSH_SIZE (1 << 20)
+#endif
+
+/**
+ * @class OutputSink
+ * @brief Collects the output in a growable in-memory buffer and hands it to the system in large writes.
+ *
+ * Nothing is flushed per line: the buffer is written out with write(2) once it holds
+ * OUTPUT_SINK_FLUSH_SIZE bytes, and when the sink is flushed or closed. A piece of text too large to be
+ * worth copying is written together with the buffer by a single writev(2). Indentation is copied from
+ * a prebuilt run of spaces. On non-POSIX systems the sink writes to a std::ofstream instead. A sink can
+ * also keep everything in memory (see `open_memory`).
+ *
+ * @see HTML_Visitor
+ * @see CSS_Constructor
+ */
+class OutputSink
+{
+public:
+    OutputSink()
+    {
+        ALLOCATION_SITE(OutputBuffer);
+        buffer.reserve(OUTPUT_SINK_FLUSH_SIZE);
+    }
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    /**
+     * @brief Writes out whatever is left in the buffer. Errors are ignored here, call `close` to see them.
+     */
+    ~OutputSink()
+    {
+        try {
+            close();
+        } catch (std::runtime_error&) {}
+    }
+
+    /**
+     * @brief Creates (or truncates) the file at the given path.
+     *
+     * @param path The path to the output file.
+     * @return true if the file could be opened for writing, false otherwise.
+     */
+    bool open(const std::string& path)
+    {
+        close();
+        if (in_memory)
+            buffer.clear();
+        in_memory = false;
+#ifdef OUTPUT_SINK_POSIX
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        return fd >= 0;
+#else
+        stream.open(path, std::ios::binary);
+        return !stream.fail();
+#endif
+    }
+
+    /**
+     * @brief Collects the whole output in memory instead of writing it to a file (see `contents`), e.g. to
+     * send it somewhere else. Whatever was collected before is dropped, but the buffer keeps its capacity,
+     * so a sink reused for many small outputs stops allocating.
+     */
+    void open_memory()
+    {
+        close();
+        buffer.clear();
+        bytes_written = 0;
+        in_memory = true;
+    }
+
+    /**
+     * @brief Returns the output collected since `open_memory`.
+     */
+    std::string_view contents() const
+    {
+        return buffer;
+    }
+
+    /**
+     * @brief Writes out the buffer and closes the file.
+     * @throws std::runtime_error If the buffer could not be written.
+     */
+    void close()
+    {
+        flush();
+#ifdef OUTPUT_SINK_POSIX
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+#else
+        if (stream.is_open())
+            stream.close();
+#endif
+    }
+
+    /**
+     * @brief Writes out the buffer.
+     * @throws std::runtime_error If the buffer could not be written.
+     */
+    void flush()
+    {
+        write_out(std::string_view());
+    }
+
+    OutputSink& operator<<(std::string_view text)
+    {
+        ALLOCATION_SITE(OutputBuffer);
+        if (buffer.size() + text.size() <= OUTPUT_SINK_FLUSH_SIZE)
+            buffer.append(text);
+        else if (text.size() >= OUTPUT_SINK_FLUSH_SIZE / 2)
+            write_out(text);
+        else
+        {
+            buffer.append(text);
+            write_out(std::string_view());
+        }
+        return *this;
+    }
+
+    OutputSink& operator<<(char c)
+    {
+        ALLOCATION_SITE(OutputBuffer);
+        buffer.push_back(c);
+        if (buffer.size() >= OUTPUT_SINK_FLUSH_SIZE)
+            write_out(std::string_view());
+        return *this;
+    }
+
+    /**
+     * @brief Writes `count` spaces.
+     */
+    void indent(size_t count)
+    {
+        while (count > 0)
+        {
+            size_t run = std::min(count, sizeof(SPACES) - 1);
+            *this << std::string_view(SPACES, run);
+            count -= run;
+        }
+    }
+
+    /**
+     * @brief Returns the number of writes issued to the system so far.
+     */
+    size_t get_write_calls() const
+    {
+        return write_calls;
+    }
+
+    /**
+     * @brief Returns the number of bytes written so far, including those still in the buffer.
+     */
+    size_t get_bytes_written() const
+    {
+        return bytes_written + buffer.size();
+    }
+
+private:
+    static constexpr char SPACES[] =
+        "                                                                "
+        "                                                                ";
+
+    std::string buffer;
+    size_t write_calls = 0;
+    size_t bytes_written = 0;  // not counting the buffer
+    bool in_memory = false;  // see open_memory, the buffer is then never written out
+#ifdef OUTPUT_SINK_POSIX
+    int fd = -1;
+#else
+    std::ofstream stream;
+#endif
+
+    /**
+     * @brief Writes the buffer followed by `tail` and empties the buffer.
+     */
+    void write_out(std::string_view tail)
+    {
+        if (in_memory)
+        {
+            buffer.append(tail);
+            return;
+        }
+        if (buffer.empty() && tail.empty())
+            return;
+        bytes_written += buffer.size() + tail.size();
+#ifdef OUTPUT_SINK_POSIX
+        if (fd < 0)
+            throw std::runtime_error("writing to a closed output file");
+        struct iovec parts[2] = {
+            {const_cast<char*>(buffer.data()), buffer.size()},
+            {const_cast<char*>(tail.data()), tail.size()},
+        };
+        struct iovec* first = parts;
+        int count = tail.empty() ? 1 : 2;
+        while (count > 0)
+        {
+            ++write_calls;
+            ssize_t written = count == 1 ? ::write(fd, first->iov_base, first->iov_len) : ::writev(fd, first, count);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written < 0)
+                throw std::runtime_error("unable to write the output file");
+            // skip what has been written, a write may be partial
+            while (count > 0 && static_cast<size_t>(written) >= first->iov_len)
+            {
+                written -= first->iov_len;
+                ++first;
+                --count;
+            }
+            if (count > 0)
+            {
+                first->iov_base = static_cast<char*>(first->iov_base) + written;
+                first->iov_len -= written;
+            }
+        }
+#else
+        ++write_calls;
+        stream.write(buffer.data(), buffer.size());
+        stream.write(tail.data(), tail.size());
+        if (stream.fail())
+            throw std::runtime_error("unable to write the output file");
+#endif
+        buffer.clear();
+    }
+};
+
+#endif
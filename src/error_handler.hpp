@@ -4,6 +4,18 @@
 #include <iostream>
 #include <fstream>
 #include <chrono>
+#include <ctime>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
 
 enum ErrorType
 {
@@ -11,6 +23,9 @@ enum ErrorType
     MissingInput,
     UnableToOpenInput,
     UnableToOpenOutput,
+    UnableToOpenSocket,
+    UnableToOpenCache,
+    UnableToOpenTree,
 };
 
 void handle_error(ErrorType err)
@@ -29,16 +44,68 @@ void handle_error(ErrorType err)
     case UnableToOpenOutput:
         std::cerr << "Unable to open the output file. Make sure it exists and is written correctly" << std::endl;
         break;
+    case UnableToOpenSocket:
+        std::cerr << "Unable to create the socket. Make sure its directory exists and the path is not too long" << std::endl;
+        break;
+    case UnableToOpenCache:
+        std::cerr << "Unable to open the cache directory. Make sure it can be created and written to" << std::endl;
+        break;
+    case UnableToOpenTree:
+        std::cerr << "Unable to read the saved tree. Make sure it exists and was written by this build of the converter" << std::endl;
+        break;
     default:
 
         break;
     }
 }
 
+/**
+ * @brief The highest verbosity level compiled in: messages above it are dropped at compile time.
+ * 3 keeps everything, 2 compiles out info messages, 1 compiles out warnings as well.
+ */
+#ifndef LOGGER_MAX_LEVEL
+#define LOGGER_MAX_LEVEL 3
+#endif
+
+/**
+ * @brief Logging macros which check the level before the message is evaluated, so that building
+ *        the message costs nothing when it would be dropped. Prefer them over calling Logger directly
+ *        whenever the message is not a plain literal.
+ * @param logger A pointer to a Logger.
+ */
+#define LOG_INFO(logger, message) \
+    do { if (LOGGER_MAX_LEVEL >= 3 && (logger)->enabled(3)) (logger)->log_info(message); } while (0)
+#define LOG_WARNING(logger, ...) \
+    do { if (LOGGER_MAX_LEVEL >= 2 && (logger)->enabled(2)) (logger)->log_warning(__VA_ARGS__); } while (0)
+#define LOG_ERROR(logger, message) \
+    do { if ((logger)->enabled(1)) (logger)->log_error(message); } while (0)
+
+/**
+ * @brief The number of records the ring of a Logger holds (a power of two). A thread logging into a full ring
+ *        waits for the writer thread to make room.
+ */
+#ifndef LOGGER_RING_SIZE
+#define LOGGER_RING_SIZE (1 << 14)
+#endif
+
+/**
+ * @brief The number of message characters held by one record. Longer messages take several consecutive records.
+ */
+#ifndef LOGGER_RECORD_TEXT_SIZE
+#define LOGGER_RECORD_TEXT_SIZE 96
+#endif
+
 /**
  * @class Logger
  * @brief A class for logging messages to a file. It provides methods for logging info, warnings, and errors.
  *        The verbosity level determines the level of messages that will be logged.
+ *
+ * Logging only copies the message into a fixed-size record of a lock-free ring, stamped with the monotonic
+ * clock. A background thread takes the records out in order, formats them and writes them to the file,
+ * flushing whenever the ring has been emptied. The writer then waits on a condition variable, which a producer
+ * only notifies when it finds the writer waiting, so an idle Logger costs nothing. The wall-clock time of a record is derived from its monotonic
+ * stamp and the date and time text is formatted at most once per second. A single Logger can be shared
+ * by several threads, each message is written as a whole; the records of a thread keep their order.
  */
 class Logger
 {
@@ -52,7 +119,75 @@ public:
      * @brief Constructs a Logger object.
      * @param verbosity The verbosity level (0: no logging, 1: errors only, 2: warnings and errors, 3: all messages).
      */
-    Logger(size_t verbosity) : log_stream(std::ofstream("logs.log", std::ios::app)), verbosity(verbosity) {}
+    Logger(size_t verbosity)
+    : verbosity(verbosity),
+      log_stream(std::ofstream("logs.log", std::ios::app)),
+      ring(std::make_unique<Slot[]>(LOGGER_RING_SIZE)),
+      start_steady(std::chrono::steady_clock::now()),
+      start_wall(std::chrono::system_clock::now())
+    {
+        for (size_t i = 0; i < LOGGER_RING_SIZE; ++i)
+            ring[i].sequence.store(i, std::memory_order_relaxed);
+        writer = std::thread([this] { write_records(); });
+    }
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    /**
+     * @brief Writes the records still in the ring and stops the writer thread.
+     */
+    ~Logger()
+    {
+        if (!writer.joinable())
+            return;
+        stopping = true;
+        {
+            std::lock_guard<std::mutex> lock(park_mutex);
+        }
+        wake_writer.notify_one();
+        writer.join();
+    }
+
+    /**
+     * @brief Constructs a Logger object which keeps its messages in memory instead of writing them,
+     *        so that they can be written later (or dropped) by replay.
+     * @param target The Logger whose verbosity is used.
+     */
+    static std::unique_ptr<Logger> recording(const Logger& target)
+    {
+        std::unique_ptr<Logger> logger = std::make_unique<Logger>();
+        logger->verbosity = target.verbosity;
+        logger->is_recording = true;
+        return logger;
+    }
+
+    /**
+     * @brief Returns whether messages of the given level are logged (1: errors, 2: warnings, 3: info).
+     */
+    bool enabled(size_t level) const
+    {
+        return level <= verbosity && level <= LOGGER_MAX_LEVEL;
+    }
+
+    /**
+     * @brief Passes the messages kept by a recording Logger on to another Logger, in order.
+     *        They keep the time they were logged at.
+     * @param target The Logger to log the messages with.
+     * @param source If not empty, put in front of every message, e.g. the name of the document it is about.
+     */
+    void replay(Logger& target, const std::string& source = "")
+    {
+        for (auto&& record : records)
+        {
+            if (!target.enabled(record.level))
+                continue;
+            if (!source.empty())
+                record.message = source + ": " + record.message;
+            target.log(record.level, record.message, record.line, record.time);
+        }
+        records.clear();
+    }
 
     /**
      * @brief Logs an info message.
@@ -60,10 +195,9 @@ public:
      */
     void log_info(std::string&& message)
     {
-        if (verbosity < 3)
+        if (!enabled(3))
             return;
-        std::time_t curr = get_curr_time();
-        log_stream << "INFO at " << std::ctime(&curr) << ": " << message << std::endl;
+        log(3, std::move(message), 0, std::chrono::steady_clock::now());
     }
 
     /**
@@ -73,13 +207,9 @@ public:
      */
     void log_warning(const std::string& message, const size_t& line = 0)
     {
-        if (verbosity < 2)
+        if (!enabled(2))
             return;
-        std::time_t curr = get_curr_time();
-        if (line == 0)
-            log_stream << "WARNING at " << std::ctime(&curr) << ": " << message << std::endl;
-        else
-            log_stream << "WARNING at " << std::ctime(&curr) << ": line " << line << ": " << message << std::endl;
+        log(2, message, line, std::chrono::steady_clock::now());
     }
 
     /**
@@ -88,13 +218,9 @@ public:
      */
     void log_warning(std::string&& message, const size_t& line = 0)
     {
-        if (verbosity < 2)
+        if (!enabled(2))
             return;
-        std::time_t curr = get_curr_time();
-        if (line == 0)
-            log_stream << "WARNING at " << std::ctime(&curr) << ": " << message << std::endl;
-        else
-            log_stream << "WARNING at " << std::ctime(&curr) << ": line " << line << ": " << message << std::endl;
+        log(2, std::move(message), line, std::chrono::steady_clock::now());
     }
 
     /**
@@ -103,19 +229,165 @@ public:
      */
     void log_error(std::string&& message)
     {
-        if (verbosity < 1)
+        if (!enabled(1))
             return;
-        std::time_t curr = get_curr_time();
-        log_stream << "ERROR at " << std::ctime(&curr) << ": " << message << std::endl;
+        log(1, std::move(message), 0, std::chrono::steady_clock::now());
     }
 private:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    size_t verbosity = 0;
+
+    struct Record
+    {
+        size_t level;  // the verbosity needed for the message, as in the constructor
+        std::string message;
+        size_t line;
+        TimePoint time;
+    };
+    bool is_recording = false;
+    std::vector<Record> records;
+
+    /**
+     * @brief A slot of the ring. `sequence` tells whose turn it is: a producer may fill the slot taking
+     *        position `pos` when it equals `pos`, the writer may take it out when it equals `pos + 1`.
+     */
+    struct alignas(64) Slot
+    {
+        std::atomic<size_t> sequence;
+        TimePoint time;
+        size_t line;
+        uint8_t level;
+        bool continued;  // the message goes on in the next slot
+        uint16_t length;
+        char text[LOGGER_RECORD_TEXT_SIZE];
+    };
+
     std::ofstream log_stream;
-    size_t verbosity;
+    std::unique_ptr<Slot[]> ring;
+    std::atomic<size_t> head = 0;  // the next position to be taken by a producer
+    size_t tail = 0;  // the next position to be written, only used by the writer
+    std::atomic<bool> stopping = false;
+    std::thread writer;
+    std::atomic<bool> parked = false;  // whether the writer waits for records
+    std::mutex park_mutex;
+    std::condition_variable wake_writer;
+
+    TimePoint start_steady;
+    std::chrono::system_clock::time_point start_wall;
+    std::time_t formatted_second = -1;
+    char formatted_time[32];  // the date and time of `formatted_second`
 
-    std::time_t get_curr_time()
+    /**
+     * @brief Keeps the message of a recording Logger, or copies it into as many consecutive slots of the ring as needed.
+     */
+    void log(size_t level, std::string_view message, size_t line, TimePoint time)
+    {
+        if (is_recording)
+            return records.push_back(Record{level, std::string(message), line, time});
+
+        size_t count = std::max<size_t>(1, (message.size() + LOGGER_RECORD_TEXT_SIZE - 1) / LOGGER_RECORD_TEXT_SIZE);
+        size_t pos = head.fetch_add(count, std::memory_order_relaxed);
+        for (size_t i = 0; i < count; ++i, ++pos)
+        {
+            Slot& slot = ring[pos % LOGGER_RING_SIZE];
+            while (slot.sequence.load(std::memory_order_acquire) != pos)
+                std::this_thread::yield();  // the ring is full
+            std::string_view part = message.substr(i * LOGGER_RECORD_TEXT_SIZE, LOGGER_RECORD_TEXT_SIZE);
+            slot.time = time;
+            slot.line = line;
+            slot.level = static_cast<uint8_t>(level);
+            slot.continued = i + 1 < count;
+            slot.length = static_cast<uint16_t>(part.size());
+            std::memcpy(slot.text, part.data(), part.size());
+            slot.sequence.store(pos + 1, std::memory_order_release);
+        }
+
+        // pairs with the writer parking before it looks at the ring again, so that one of them sees the other
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (parked.load(std::memory_order_relaxed))
+        {
+            {
+                std::lock_guard<std::mutex> lock(park_mutex);
+                parked.store(false, std::memory_order_relaxed);
+            }
+            wake_writer.notify_one();
+        }
+    }
+
+    /**
+     * @brief The loop of the writer thread: writes records until the Logger is destroyed and the ring is empty.
+     */
+    void write_records()
+    {
+        std::string message;
+        bool unflushed = false;
+        while (true)
+        {
+            Slot& slot = ring[tail % LOGGER_RING_SIZE];
+            if (slot.sequence.load(std::memory_order_acquire) != tail + 1)
+            {
+                if (unflushed)
+                    log_stream.flush();
+                unflushed = false;
+                if (stopping && head.load() == tail)
+                    return;
+                std::unique_lock<std::mutex> lock(park_mutex);
+                parked.store(true);
+                if (slot.sequence.load() != tail + 1 && !stopping)
+                    wake_writer.wait(lock, [this] { return !parked.load(std::memory_order_relaxed) || stopping; });
+                parked.store(false, std::memory_order_relaxed);
+                continue;
+            }
+            unflushed = true;
+
+            message.append(slot.text, slot.length);
+            if (!slot.continued)
+            {
+                write_record(slot, message);
+                message.clear();
+            }
+            slot.sequence.store(tail + LOGGER_RING_SIZE, std::memory_order_release);
+            ++tail;
+        }
+    }
+
+    void write_record(const Slot& slot, const std::string& message)
+    {
+        switch (slot.level)
+        {
+        case 3:
+            log_stream << "INFO at ";
+            break;
+        case 2:
+            log_stream << "WARNING at ";
+            break;
+        default:
+            log_stream << "ERROR at ";
+            break;
+        }
+        write_time(slot.time);
+        if (slot.line != 0)
+            log_stream << ": line " << slot.line;
+        log_stream << ": " << message << '\n';
+    }
+
+    /**
+     * @brief Writes the wall-clock time of a monotonic time stamp, with milliseconds.
+     */
+    void write_time(TimePoint time)
     {
-        auto time = std::chrono::system_clock::now();
-        return std::chrono::system_clock::to_time_t(time);
+        auto wall = start_wall + std::chrono::duration_cast<std::chrono::system_clock::duration>(time - start_steady);
+        auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(wall.time_since_epoch()).count();
+        std::time_t second = static_cast<std::time_t>(millis / 1000);
+        if (second != formatted_second)
+        {
+            formatted_second = second;
+            std::strftime(formatted_time, sizeof(formatted_time), "%Y-%m-%d %H:%M:%S", std::localtime(&second));
+        }
+        char fraction[5] = {'.', static_cast<char>('0' + millis / 100 % 10), static_cast<char>('0' + millis / 10 % 10),
+            static_cast<char>('0' + millis % 10), '\0'};
+        log_stream << formatted_time << fraction;
     }
 };
 
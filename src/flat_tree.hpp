@@ -0,0 +1,203 @@
+/**
+ * @file flat_tree.hpp
+ * @brief A parsing tree stored as a structure of arrays.
+ */
+
+#ifndef _FLAT_TREE_HPP
+#define _FLAT_TREE_HPP
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <utility>
+#include "token.hpp"
+#include "node.hpp"
+
+/**
+ * @brief The position of a node in a FlatTree.
+ */
+using NodeIndex = uint32_t;
+
+/**
+ * @brief Stands for a missing node (no parent, child or sibling) or a missing payload.
+ */
+constexpr NodeIndex NO_NODE = UINT32_MAX;
+
+/**
+ * @brief A set of attributes, bit `i` standing for the Attribute with the value `i`.
+ */
+using AttributeMask = uint32_t;
+
+static_assert(Attribute::ImageAttr < 32, "Attributes have to fit into an AttributeMask");
+
+/**
+ * @struct LinkPayload
+ * @brief The strings of an image (src, alt, title) or of a hyperlink (href, displayed text, title).
+ */
+struct LinkPayload
+{
+    std::string target;
+    std::string text;
+    std::string title;
+};
+
+/**
+ * @struct FlatTree
+ * @brief The parsing tree as a structure of arrays indexed by 32-bit node indices, an alternative to the
+ * pointer-linked Node tree.
+ *
+ * Node `i` is described by the i-th entry of every per-node array. Nodes are stored in document order
+ * (a preorder of the tree), so every subtree is a contiguous range of indices and the tree can be written out
+ * by a single linear pass using `depths` alone; the parent, first-child and next-sibling links are there for
+ * random access. Node 0 is the DOCSTART root.
+ *
+ * The text of Content nodes lives in the `contents` table (usually as spans of the input buffer, see Text),
+ * the strings of images and hyperlinks in the `links` table; `payloads` holds the index into the table
+ * matching the element of the node.
+ *
+ * @see TreeBuilder::build_flat
+ */
+struct FlatTree
+{
+    std::vector<ElementType> elements;
+    std::vector<AttributeMask> attributes;
+    std::vector<uint32_t> depths;  // the root has depth 0
+    std::vector<NodeIndex> parents;
+    std::vector<NodeIndex> first_children;
+    std::vector<NodeIndex> next_siblings;
+    std::vector<NodeIndex> last_children;  // only needed for appending children in constant time
+    std::vector<uint32_t> payloads;
+    std::vector<Text> contents;
+    std::vector<LinkPayload> links;
+
+    /**
+     * @brief Constructs a tree holding only the DOCSTART root.
+     */
+    FlatTree()
+    {
+        push_node(ElementType::DOCSTART, NO_NODE, NO_NODE);
+    }
+
+    /**
+     * @brief Returns the number of nodes, including the root.
+     */
+    size_t size() const
+    {
+        return elements.size();
+    }
+
+    /**
+     * @brief Appends a node without a payload as the last child of `parent`.
+     * @return The index of the new node.
+     */
+    NodeIndex add_node(ElementType element, NodeIndex parent)
+    {
+        return push_node(element, parent, NO_NODE);
+    }
+
+    /**
+     * @brief Appends a content node as the last child of `parent`.
+     * @return The index of the new node.
+     */
+    NodeIndex add_content(ElementType element, NodeIndex parent, Text&& content)
+    {
+        contents.push_back(std::move(content));
+        return push_node(element, parent, static_cast<uint32_t>(contents.size() - 1));
+    }
+
+    /**
+     * @brief Appends an image or a hyperlink node as the last child of `parent`.
+     * @return The index of the new node.
+     */
+    NodeIndex add_link(ElementType element, NodeIndex parent, std::string&& target, std::string&& text, std::string&& title)
+    {
+        links.push_back(LinkPayload{std::move(target), std::move(text), std::move(title)});
+        return push_node(element, parent, static_cast<uint32_t>(links.size() - 1));
+    }
+
+    /**
+     * @brief Adds an attribute to a node.
+     */
+    void add_attribute(NodeIndex node, Attribute attribute)
+    {
+        attributes[node] |= AttributeMask(1) << attribute;
+    }
+
+    /**
+     * @brief Returns whether a node has an attribute.
+     */
+    bool has_attribute(NodeIndex node, Attribute attribute) const
+    {
+        return (attributes[node] >> attribute) & 1;
+    }
+
+    /**
+     * @brief Returns the index following the subtree of `node`, i.e. the next node which is not its descendant.
+     */
+    NodeIndex subtree_end(NodeIndex node) const
+    {
+        NodeIndex end = node + 1;
+        while (end < size() && depths[end] > depths[node])
+            ++end;
+        return end;
+    }
+
+    /**
+     * @brief Copies a pointer-linked (sub)tree, e.g. one built by TableManager, as the last child of `parent`.
+     * The texts of its content nodes are moved out.
+     * @return The index of the copied root.
+     */
+    NodeIndex append_subtree(NodeIndex parent, Node* subtree_root)
+    {
+        NodeIndex copied_root = NO_NODE;
+        std::vector<std::pair<Node*, NodeIndex>> stack{{subtree_root, parent}};
+        while (!stack.empty())
+        {
+            auto [node, node_parent] = stack.back();
+            stack.pop_back();
+
+            NodeIndex index;
+            if (auto content = dynamic_cast<ContentNode*>(node))
+                index = add_content(node->element, node_parent, std::move(content->content));
+            else if (auto image = dynamic_cast<ImageNode*>(node))
+                index = add_link(node->element, node_parent, std::move(image->src), std::move(image->alt), std::move(image->title));
+            else if (auto link = dynamic_cast<HyperlinkNode*>(node))
+                index = add_link(node->element, node_parent, std::move(link->href), std::move(link->displayed), std::move(link->title));
+            else
+                index = add_node(node->element, node_parent);
+            for (Attribute attribute : node->attributes)
+                add_attribute(index, attribute);
+            if (copied_root == NO_NODE)
+                copied_root = index;
+
+            for (auto it = node->children.rbegin(); it != node->children.rend(); ++it)
+                stack.push_back({*it, index});
+        }
+        return copied_root;
+    }
+
+private:
+    NodeIndex push_node(ElementType element, NodeIndex parent, uint32_t payload)
+    {
+        NodeIndex index = static_cast<NodeIndex>(elements.size());
+        elements.push_back(element);
+        attributes.push_back(0);
+        depths.push_back(parent == NO_NODE ? 0 : depths[parent] + 1);
+        parents.push_back(parent);
+        first_children.push_back(NO_NODE);
+        next_siblings.push_back(NO_NODE);
+        last_children.push_back(NO_NODE);
+        payloads.push_back(payload);
+        if (parent != NO_NODE)
+        {
+            if (last_children[parent] == NO_NODE)
+                first_children[parent] = index;
+            else
+                next_siblings[last_children[parent]] = index;
+            last_children[parent] = index;
+        }
+        return index;
+    }
+};
+
+#endif
@@ -0,0 +1,374 @@
+/**
+ * @file flat_tree_file.hpp
+ * @brief A binary file holding a FlatTree, read back by mapping it into memory.
+ */
+
+#ifndef _FLAT_TREE_FILE_HPP
+#define _FLAT_TREE_FILE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include "flat_tree.hpp"
+#include "./parsing/input_source.hpp"
+#include "./building/output_sink.hpp"
+
+/**
+ * @struct StringRef
+ * @brief A string of the strings section of a tree file: its offset and length.
+ */
+struct StringRef
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+/**
+ * @class ArrayView
+ * @brief A read-only array of a mapped tree file.
+ */
+template <typename T>
+class ArrayView
+{
+public:
+    ArrayView() = default;
+
+    ArrayView(const T* data, size_t count)
+    : data(data),
+      count(count) {}
+
+    const T& operator[](size_t i) const
+    {
+        return data[i];
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+private:
+    const T* data = nullptr;
+    size_t count = 0;
+};
+
+/**
+ * @struct MappedText
+ * @brief The text of a content node of a mapped tree, the counterpart of Text.
+ */
+struct MappedText
+{
+    std::string_view text;
+
+    std::string_view view() const
+    {
+        return text;
+    }
+};
+
+/**
+ * @struct MappedLink
+ * @brief The strings of an image or a hyperlink of a mapped tree, the counterpart of LinkPayload.
+ */
+struct MappedLink
+{
+    std::string_view target;
+    std::string_view text;
+    std::string_view title;
+};
+
+/**
+ * @struct FlatTreeView
+ * @brief A FlatTree read from a tree file (see FlatTreeFile), pointing into the mapped file.
+ *
+ * It has the members of a FlatTree needed to walk it in document order, with the same names, so that
+ * code written against both (e.g. HTML_Visitor::visit_flat) does not tell them apart. The parent, child
+ * and sibling links are not stored, they follow from the depths. The texts and links are looked up in the
+ * strings section as they are accessed, nothing is allocated.
+ */
+struct FlatTreeView
+{
+    /**
+     * @brief The texts (or links, three strings each) of a mapped tree.
+     */
+    template <typename Payload>
+    class Strings
+    {
+    public:
+        Strings() = default;
+
+        Strings(const StringRef* refs, size_t count, const char* strings)
+        : refs(refs),
+          count(count),
+          strings(strings) {}
+
+        Payload operator[](size_t i) const
+        {
+            if constexpr (std::is_same_v<Payload, MappedText>)
+                return MappedText{string(refs[i])};
+            else
+                return MappedLink{string(refs[3 * i]), string(refs[3 * i + 1]), string(refs[3 * i + 2])};
+        }
+
+        size_t size() const
+        {
+            return count;
+        }
+
+    private:
+        const StringRef* refs = nullptr;
+        size_t count = 0;
+        const char* strings = nullptr;
+
+        std::string_view string(StringRef ref) const
+        {
+            return std::string_view(strings + ref.offset, ref.length);
+        }
+    };
+
+    ArrayView<ElementType> elements;
+    ArrayView<AttributeMask> attributes;
+    ArrayView<uint32_t> depths;
+    ArrayView<uint32_t> payloads;
+    Strings<MappedText> contents;
+    Strings<MappedLink> links;
+
+    size_t size() const
+    {
+        return elements.size();
+    }
+
+    bool has_attribute(NodeIndex node, Attribute attribute) const
+    {
+        return (attributes[node] >> attribute) & 1;
+    }
+
+    /**
+     * @brief Returns the index following the subtree of `node` (see FlatTree::subtree_end).
+     */
+    NodeIndex subtree_end(NodeIndex node) const
+    {
+        NodeIndex end = node + 1;
+        while (end < size() && depths[end] > depths[node])
+            ++end;
+        return end;
+    }
+};
+
+/**
+ * @class FlatTreeFile
+ * @brief Saves a parsed FlatTree into a compact binary file, and maps such a file back as a FlatTreeView,
+ * so that a document rendered again (e.g. with other settings) does not have to be parsed again.
+ *
+ * The file is the per-node arrays of the tree as they are in memory, followed by the strings of its texts
+ * and links, so mapping it is all it takes to read it back:
+ *
+ *     header (40 bytes): "MDFT" | u32 format | u32 byte order mark | u32 nodes | u32 contents | u32 links
+ *                        | u32 element types | u32 attributes | u64 strings size
+ *     u32 attributes[nodes] | u32 depths[nodes] | u32 payloads[nodes] | u8 elements[nodes]
+ *     StringRef contents[contents] | StringRef links[3 * links] (target, text, title) | char strings[]
+ *
+ * Every section starts at a multiple of 8 bytes. The integers are in the byte order of the machine writing
+ * the file; a file of another byte order, format or set of element types and attributes is refused rather
+ * than converted. A mapped file is checked once in a single pass (every index and string in bounds, depths
+ * of a tree), so a corrupt file is refused instead of read out of bounds.
+ */
+class FlatTreeFile
+{
+public:
+    FlatTreeFile() = default;
+
+    FlatTreeFile(const FlatTreeFile&) = delete;
+    FlatTreeFile& operator=(const FlatTreeFile&) = delete;
+
+    /**
+     * @brief Writes a tree into a file.
+     * @throws std::runtime_error If the file could not be written or the strings take 4 GiB or more.
+     */
+    static void write(const FlatTree& tree, OutputSink& out)
+    {
+        uint64_t strings_size = 0;
+        std::vector<StringRef> content_refs;
+        for (const Text& text : tree.contents)
+            content_refs.push_back(make_ref(strings_size, text.view().size()));
+        std::vector<StringRef> link_refs;
+        for (const LinkPayload& link : tree.links)
+        {
+            link_refs.push_back(make_ref(strings_size, link.target.size()));
+            link_refs.push_back(make_ref(strings_size, link.text.size()));
+            link_refs.push_back(make_ref(strings_size, link.title.size()));
+        }
+
+        Header header{};
+        std::memcpy(header.magic, MAGIC, 4);
+        header.format = FORMAT;
+        header.byte_order = BYTE_ORDER_MARK;
+        header.nodes = static_cast<uint32_t>(tree.size());
+        header.contents = static_cast<uint32_t>(tree.contents.size());
+        header.links = static_cast<uint32_t>(tree.links.size());
+        header.element_types = ElementType::EOF_Reached + 1;
+        header.attributes = static_cast<uint32_t>(attr_enum_to_name.size());
+        header.strings_size = strings_size;
+
+        uint64_t written = 0;
+        write_section(out, written, &header, sizeof(header));
+        write_section(out, written, tree.attributes.data(), tree.size() * sizeof(AttributeMask));
+        write_section(out, written, tree.depths.data(), tree.size() * sizeof(uint32_t));
+        write_section(out, written, tree.payloads.data(), tree.size() * sizeof(uint32_t));
+        write_section(out, written, tree.elements.data(), tree.size() * sizeof(ElementType));
+        write_section(out, written, content_refs.data(), content_refs.size() * sizeof(StringRef));
+        write_section(out, written, link_refs.data(), link_refs.size() * sizeof(StringRef));
+        for (const Text& text : tree.contents)
+            out << text.view();
+        for (const LinkPayload& link : tree.links)
+            out << link.target << link.text << link.title;
+    }
+
+    /**
+     * @brief Maps a tree file.
+     * @return Whether it is a valid tree file of this build, its tree is then in `tree`.
+     */
+    bool open(const std::string& path)
+    {
+        view = FlatTreeView();
+        if (!file.open(path))
+            return false;
+        std::string_view bytes = file.view();
+        if (bytes.size() < sizeof(Header) || reinterpret_cast<uintptr_t>(bytes.data()) % alignof(uint64_t) != 0)
+            return false;
+        Header header;
+        std::memcpy(&header, bytes.data(), sizeof(Header));
+        if (std::memcmp(header.magic, MAGIC, 4) != 0 || header.format != FORMAT || header.byte_order != BYTE_ORDER_MARK
+            || header.element_types != ElementType::EOF_Reached + 1 || header.attributes != attr_enum_to_name.size()
+            || header.nodes == 0)
+            return false;
+
+        // the sections are laid out as by `write`, checking every one of them fits
+        uint64_t offset = sizeof(Header);
+        auto section = [&](uint64_t size) -> const char* {
+            uint64_t start = offset;
+            if (start > bytes.size() || size > bytes.size() - start)
+                return nullptr;
+            offset = align(start + size);
+            return bytes.data() + start;
+        };
+        uint64_t nodes = header.nodes;
+        const char* attributes = section(nodes * sizeof(AttributeMask));
+        const char* depths = attributes ? section(nodes * sizeof(uint32_t)) : nullptr;
+        const char* payloads = depths ? section(nodes * sizeof(uint32_t)) : nullptr;
+        const char* elements = payloads ? section(nodes * sizeof(ElementType)) : nullptr;
+        const char* contents = elements ? section(uint64_t(header.contents) * sizeof(StringRef)) : nullptr;
+        const char* links = contents ? section(uint64_t(header.links) * 3 * sizeof(StringRef)) : nullptr;
+        if (links == nullptr || offset > bytes.size() || header.strings_size != bytes.size() - offset)
+            return false;
+        const char* strings = bytes.data() + offset;
+
+        FlatTreeView mapped;
+        mapped.attributes = ArrayView<AttributeMask>(reinterpret_cast<const AttributeMask*>(attributes), nodes);
+        mapped.depths = ArrayView<uint32_t>(reinterpret_cast<const uint32_t*>(depths), nodes);
+        mapped.payloads = ArrayView<uint32_t>(reinterpret_cast<const uint32_t*>(payloads), nodes);
+        mapped.elements = ArrayView<ElementType>(reinterpret_cast<const ElementType*>(elements), nodes);
+        mapped.contents = FlatTreeView::Strings<MappedText>(reinterpret_cast<const StringRef*>(contents), header.contents, strings);
+        mapped.links = FlatTreeView::Strings<MappedLink>(reinterpret_cast<const StringRef*>(links), header.links, strings);
+        if (!check(mapped, reinterpret_cast<const StringRef*>(contents), uint64_t(header.contents) + 3 * uint64_t(header.links), header.strings_size))
+            return false;
+        view = mapped;
+        return true;
+    }
+
+    /**
+     * @brief Returns the tree of the file opened last, valid as long as the FlatTreeFile.
+     */
+    const FlatTreeView& tree() const
+    {
+        return view;
+    }
+
+private:
+    static constexpr char MAGIC[4] = {'M', 'D', 'F', 'T'};
+    static constexpr uint32_t FORMAT = 1;
+    static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t format;
+        uint32_t byte_order;
+        uint32_t nodes;
+        uint32_t contents;
+        uint32_t links;
+        uint32_t element_types;
+        uint32_t attributes;
+        uint64_t strings_size;
+    };
+
+    static_assert(sizeof(Header) == 40, "the header has no padding");
+    static_assert(sizeof(StringRef) == 8, "a StringRef has no padding");
+    static_assert(sizeof(ElementType) == 1, "element types are stored as bytes");
+
+    InputSource file;
+    FlatTreeView view;
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 7) & ~uint64_t(7);
+    }
+
+    static StringRef make_ref(uint64_t& strings_size, size_t length)
+    {
+        if (strings_size + length > UINT32_MAX)
+            throw std::runtime_error("the texts of the document are too large for a tree file");
+        StringRef ref{static_cast<uint32_t>(strings_size), static_cast<uint32_t>(length)};
+        strings_size += length;
+        return ref;
+    }
+
+    /**
+     * @brief Writes a section and pads it to a multiple of 8 bytes.
+     */
+    static void write_section(OutputSink& out, uint64_t& written, const void* data, size_t size)
+    {
+        static constexpr char ZEROS[8] = {};
+        out << std::string_view(static_cast<const char*>(data), size);
+        written += size;
+        out << std::string_view(ZEROS, align(written) - written);
+        written = align(written);
+    }
+
+    /**
+     * @brief Checks that the nodes of a mapped tree form a tree in document order whose payloads and strings
+     * are all in bounds.
+     */
+    static bool check(const FlatTreeView& tree, const StringRef* refs, uint64_t ref_count, uint64_t strings_size)
+    {
+        for (uint64_t i = 0; i < ref_count; ++i)
+        {
+            if (uint64_t(refs[i].offset) + refs[i].length > strings_size)
+                return false;
+        }
+        if (tree.elements[0] != ElementType::DOCSTART || tree.depths[0] != 0)
+            return false;
+        AttributeMask known = static_cast<AttributeMask>((uint64_t(1) << attr_enum_to_name.size()) - 1);
+        for (NodeIndex i = 0; i < tree.size(); ++i)
+        {
+            ElementType element = tree.elements[i];
+            if (element >= ElementType::EOF_Reached || (tree.attributes[i] & ~known) != 0)
+                return false;
+            if (i > 0 && (tree.depths[i] == 0 || tree.depths[i] > tree.depths[i - 1] + 1))
+                return false;
+            uint32_t payload = tree.payloads[i];
+            if (payload == NO_NODE)
+                continue;
+            bool link = element == ElementType::ImageType || element == ElementType::Hypertext;
+            if (payload >= (link ? tree.links.size() : tree.contents.size()))
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -7,11 +7,237 @@
 #include <string>
 #include <fstream>
 #include <vector>
+#include <chrono>
 
 #include "error_handler.hpp"
 #include "argument_parser.hpp"
+#include "./parsing/input_source.hpp"
+#include "./parsing/streamed_input.hpp"
 #include "./parsing/markdown_parser.hpp"
+#include "./parsing/parallel_parser.hpp"
 #include "./building/html_constructor.hpp"
+#include "./building/output_sink.hpp"
+#include "batch_converter.hpp"
+#include "token_pipeline.hpp"
+#include "render_cache.hpp"
+#include "flat_tree_file.hpp"
+#include "./server/conversion_server.hpp"
+#include "stats.hpp"
+#ifdef STATE_PROFILER
+#include "./parsing/state_profiler.hpp"
+#endif
+#ifdef CONVERSION_SERVER_POSIX
+#include <csignal>
+#endif
+
+
+/**
+ * @brief Writes the state machine profile of everything parsed, in builds with STATE_PROFILER defined.
+ */
+void write_state_profile()
+{
+#ifdef STATE_PROFILER
+    if (StateProfile::write_global("state_profile.txt"))
+        std::cout << "The state machine profile has been written to state_profile.txt" << std::endl;
+#endif
+}
+
+
+/**
+ * @brief Writes the allocation profile of the whole process, in builds with ALLOCATION_ACCOUNTING defined.
+ * @param input_bytes The size of the converted input.
+ */
+void write_allocation_profile([[maybe_unused]] size_t input_bytes)
+{
+#ifdef ALLOCATION_ACCOUNTING
+    if (AllocationProfile::write_report("allocation_profile.txt", phase_names, input_bytes))
+        std::cout << "The allocation profile has been written to allocation_profile.txt" << std::endl;
+#endif
+}
+
+
+/**
+ * @brief Opens the cache of `--cache`, if given.
+ * @param memory_bytes The size of its in-memory front (see RenderCache::RenderCache).
+ * @return Whether there is no cache or it could be opened.
+ */
+bool open_cache(const Arguments& args, size_t memory_bytes, std::unique_ptr<RenderCache>& cache)
+{
+    if (args.cache_dir.empty())
+        return true;
+    cache = std::make_unique<RenderCache>(args.cache_dir, static_cast<uint64_t>(args.cache_size) << 20, memory_bytes);
+    if (cache->open())
+        return true;
+    handle_error(ErrorType::UnableToOpenCache);
+    return false;
+}
+
+
+/**
+ * @brief Prints the counters of the cache, if any.
+ */
+void print_cache_counters(const std::unique_ptr<RenderCache>& cache)
+{
+    if (cache == nullptr)
+        return;
+    CacheCounters counters = cache->get_counters();
+    std::cout << "Cache: " << counters.memory_hits + counters.disk_hits << " hits (" << counters.memory_hits
+        << " in memory), " << counters.misses << " misses, " << counters.stores << " stored, "
+        << counters.evictions << " evicted" << std::endl;
+}
+
+
+/**
+ * @brief Converts all documents of a directory or a manifest (see BatchConverter).
+ */
+int convert_batch(const Arguments& args)
+{
+    fs::path output_dir(args.output_file);
+    fs::path stylesheet = output_dir / args.styles_file;
+    std::optional<std::vector<BatchJob>> jobs = BatchConverter::collect_jobs(args.batch_source, output_dir, stylesheet);
+    if (!jobs.has_value()) {
+        handle_error(ErrorType::UnableToOpenInput);
+        return 0;
+    }
+
+    Logger logger = (args.log_verbosity == 0) ? Logger() : Logger(args.log_verbosity);
+    std::unique_ptr<RenderCache> cache;
+    if (!open_cache(args, 0, cache))
+        return 0;
+    BatchConverter converter(&logger, args.threads, args.stream);
+    converter.set_collect_stats(args.stats);
+    converter.set_cache(cache.get());
+    auto start = std::chrono::steady_clock::now();
+    size_t converted = converter.convert(*jobs);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::error_code error;
+    fs::create_directories(stylesheet.parent_path(), error);
+    OutputSink styles_stream;
+    if (!styles_stream.open(stylesheet.string())) {
+        handle_error(ErrorType::UnableToOpenOutput);
+        return 0;
+    }
+    size_t stylesheet_bytes = 0;
+    try {
+        converter.write_stylesheet(styles_stream);
+        stylesheet_bytes = styles_stream.get_bytes_written();
+        styles_stream.close();
+    } catch (std::runtime_error& err) {
+        std::cerr << "Error writing the stylesheet: " << err.what() << std::endl;
+        return 0;
+    }
+    std::cout << converted << " of " << jobs->size() << " documents have been built successfully!" << std::endl;
+    std::cout << "Converted in " << elapsed.count() << " s" << std::endl;
+    const std::vector<WorkerStats>& stats = converter.get_worker_stats();
+    for (size_t i = 0; i < stats.size(); ++i)
+        std::cout << "Worker " << i << ": busy " << stats[i].busy_seconds << " s, "
+            << stats[i].tasks << " tasks (" << stats[i].stolen << " stolen)" << std::endl;
+    print_cache_counters(cache);
+    write_state_profile();
+    size_t input_bytes = 0;
+    for (const BatchJob& job : *jobs)
+        input_bytes += job.size;
+    write_allocation_profile(input_bytes);
+    if (args.stats) {
+        converter.write_stats_json(std::cout, stylesheet_bytes, elapsed.count());
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Renders a parsing tree saved by --write-tree, without parsing (see FlatTreeFile).
+ */
+int render_tree_file(const Arguments& args)
+{
+    Stats stats;
+    Stats* collected = args.stats ? &stats : nullptr;
+    FlatTreeFile tree_file;
+    bool opened;
+    {
+        PhaseTimer timer(collected, Read);
+        opened = tree_file.open(args.read_tree);
+    }
+    if (!opened) {
+        handle_error(ErrorType::UnableToOpenTree);
+        return 0;
+    }
+
+    OutputSink output_stream;
+    OutputSink styles_stream;
+    if (!output_stream.open(args.output_file) || !styles_stream.open(args.styles_file)) {
+        handle_error(ErrorType::UnableToOpenOutput);
+        return 0;
+    }
+    Logger logger = (args.log_verbosity == 0) ? Logger() : Logger(args.log_verbosity);
+    try {
+        HTML_Builder html_builder(&logger);
+        html_builder.set_css_builder(styles_stream);
+        html_builder.set_stats(collected);
+        LOG_INFO(&logger, "Starting html building from a saved tree");
+        if (collected != nullptr)
+            collected->count_flat_nodes(tree_file.tree());
+        html_builder.build_document(output_stream, args.styles_file, tree_file.tree());
+        stats.html_bytes_out = output_stream.get_bytes_written();
+        stats.css_bytes_out = styles_stream.get_bytes_written();
+        output_stream.close();
+        styles_stream.close();
+    } catch (std::runtime_error& err) {
+        std::cerr << "Error during html construction: " << err.what() << std::endl;
+        return 0;
+    }
+    std::cout << "Your HTML document has been built successfully!" << std::endl;
+    if (args.stats) {
+        stats.write_json(std::cout, args.read_tree, true);
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+
+#ifdef CONVERSION_SERVER_POSIX
+ConversionServer* running_server = nullptr;
+
+void stop_server(int)
+{
+    running_server->stop();
+}
+#endif
+
+
+/**
+ * @brief Serves conversions on a Unix domain socket until interrupted (see ConversionServer).
+ */
+int serve(const Arguments& args)
+{
+#ifdef CONVERSION_SERVER_POSIX
+    Logger logger = (args.log_verbosity == 0) ? Logger() : Logger(args.log_verbosity);
+    std::unique_ptr<RenderCache> cache;
+    if (!open_cache(args, RENDER_CACHE_MEMORY_SIZE, cache))
+        return 0;
+    ConversionServer server(&logger, args.threads);
+    server.set_cache(cache.get());
+    if (!server.listen(args.serve_socket)) {
+        handle_error(ErrorType::UnableToOpenSocket);
+        return 0;
+    }
+    running_server = &server;
+    std::signal(SIGINT, stop_server);
+    std::signal(SIGTERM, stop_server);
+    std::signal(SIGPIPE, SIG_IGN);  // a client gone before its response is only a failed write
+    std::cout << "Serving on " << args.serve_socket << " with " << std::max<size_t>(1, args.threads)
+        << " workers, interrupt to stop." << std::endl;
+    size_t served = server.run();
+    running_server = nullptr;
+    std::cout << "Stopped after " << served << " requests." << std::endl;
+    print_cache_counters(cache);
+#else
+    std::cerr << "Serving is only supported on POSIX systems" << std::endl;
+#endif
+    return 0;
+}
 
 
 int main(int argc, char** argv) {
@@ -22,36 +248,129 @@ int main(int argc, char** argv) {
         return 0;
     }
     
+    if (!args->batch_source.empty())
+        return convert_batch(*args);
+    if (!args->serve_socket.empty())
+        return serve(*args);
+    if (!args->read_tree.empty())
+        return render_tree_file(*args);
+
     if (args->input_file.empty()) {
         handle_error(ErrorType::MissingInput);
         return 0;
     }
 
-    std::ifstream input_stream(args->input_file);
-    if (input_stream.fail()) {
+    Stats stats;
+    Stats* collected = args->stats ? &stats : nullptr;
+    InputSource input;
+    StreamedInput streamed;  // the input with --pipeline, read while it is parsed
+    bool opened;
+    {
+        PhaseTimer timer(collected, Read);
+        opened = args->pipeline ? streamed.open(args->input_file) : input.open(args->input_file);
+    }
+    if (!opened) {
         handle_error(ErrorType::UnableToOpenInput);
         return 0;
     }
+    std::string_view document = args->pipeline ? streamed.view() : input.view();
+    stats.bytes_in = document.size();
 
-    std::ofstream output_stream(args->output_file);
-    std::ofstream styles_stream(args->styles_file);
-    if (output_stream.fail() || styles_stream.fail()) {
+    OutputSink output_stream;
+    OutputSink styles_stream;
+    if (!output_stream.open(args->output_file) || !styles_stream.open(args->styles_file)) {
         handle_error(ErrorType::UnableToOpenOutput);
         return 0;
     }
     Logger logger = (args->log_verbosity == 0) ? Logger() : Logger(args->log_verbosity);
-    Md_Parser parser(input_stream, &logger);
     try {
-        logger.log_info("Starting parsing.");
-        std::unique_ptr<Node> root = parser.parse_document();
-
         HTML_Builder html_builder(&logger);
         html_builder.set_css_builder(styles_stream);
-        logger.log_info("Starting html building");
-        html_builder.build_document(output_stream, args->styles_file, std::move(root));
+        html_builder.set_stats(collected);
+        if (args->pipeline) {
+            // reading, parsing and rendering each run on a thread of their own
+            LOG_INFO(&logger, "Starting the pipeline of reading, parsing and html rendering.");
+            html_builder.set_stats(nullptr);  // rendering overlaps with parsing, only parsing is timed
+            Md_Parser parser(streamed, &logger);
+            parser.set_stats(collected);
+            TokenPipeline pipeline(html_builder.begin_render(output_stream, args->styles_file));
+            pipeline.run(parser, document);
+            html_builder.end_stream();
+        } else if (args->fused) {
+            // the HTML is written while parsing, no tree is built at all
+            LOG_INFO(&logger, "Starting parsing and html rendering from tokens.");
+            Md_Parser parser(input, &logger);
+            parser.set_stats(collected);
+            parser.set_sink(&html_builder.begin_render(output_stream, args->styles_file));
+            parser.parse_document();
+            html_builder.end_stream();
+        } else if (!args->write_tree.empty()) {
+            // the tree is parsed flat, saved for later renders and rendered
+            LOG_INFO(&logger, "Starting parsing into a flat tree.");
+            Md_Parser parser(input, &logger);
+            parser.set_stats(collected);
+            FlatTree tree;
+            {
+                PhaseTimer timer(collected, Parse);
+                tree = parser.parse_flat_document();
+            }
+            if (collected != nullptr)
+                collected->count_flat_nodes(tree);
+            OutputSink tree_stream;
+            if (!tree_stream.open(args->write_tree))
+                throw std::runtime_error("unable to open " + args->write_tree);
+            FlatTreeFile::write(tree, tree_stream);
+            tree_stream.close();
+            LOG_INFO(&logger, "Starting html building");
+            html_builder.build_document(output_stream, args->styles_file, tree);
+        } else if (args->stream) {
+            // each block is written as soon as it is parsed, so the tree never holds the whole document
+            LOG_INFO(&logger, "Starting parsing and html building block by block.");
+            Md_Parser parser(input, &logger);
+            parser.set_stats(collected);
+            html_builder.begin_stream(output_stream, args->styles_file);
+            parser.set_block_handler([&html_builder, collected](Node& block) {
+                if (collected != nullptr)
+                    collected->count_nodes(block);
+                html_builder.stream_block(block);
+            });
+            parser.parse_document();
+            html_builder.end_stream();
+        } else {
+            LOG_INFO(&logger, "Starting parsing.");
+            TreeRoot root = nullptr;
+            if (args->threads > 1) {
+                // the segments are timed on their own threads, the parse time is their sum
+                ParallelParser parser(input, &logger, args->threads);
+                parser.set_stats(collected);
+                root = parser.parse_document();
+            } else {
+                Md_Parser parser(input, &logger);
+                parser.set_stats(collected);
+                PhaseTimer timer(collected, Parse);
+                root = parser.parse_document();
+            }
+            if (collected != nullptr) {
+                for (auto&& child : root->children)
+                    collected->count_nodes(*child);
+            }
+
+            LOG_INFO(&logger, "Starting html building");
+            html_builder.build_document(output_stream, args->styles_file, std::move(root));
+        }
+        stats.html_bytes_out = output_stream.get_bytes_written();
+        stats.css_bytes_out = styles_stream.get_bytes_written();
+        output_stream.close();
+        styles_stream.close();
         
-        logger.log_info("HTML building has finished successfully");
+        LOG_INFO(&logger, "HTML building has finished successfully");
         std::cout << "Your HTML document has been built successfully!" << std::endl;
+        write_state_profile();
+        write_allocation_profile(document.size());
+        if (args->stats) {
+            stats.write_json(std::cout, args->input_file, true);
+            std::cout << std::endl;
+        }
     } catch (std::runtime_error& err) {
         std::cerr << "Error during document parsing / html construction: " << err.what() << std::endl;
         return 0;
@@ -2,6 +2,7 @@
 #define _NODE_HPP
 
 #include <memory>
+#include <memory_resource>
 #include <vector>
 #include <string>
 #include "token.hpp"
@@ -63,26 +64,30 @@ struct NodeVisitor {
  * @brief A struct representing a node in the parsing tree. It contains information about the node's type, its parent,
  * its children, and its attributes. It also provides methods for adding children and attributes, as well as accepting
  * a visitor for traversal.
+ *
+ * Nodes are owned by a `NodeArena` rather than by their parents, so children are plain pointers and the child
+ * and attribute lists are allocated from the same arena (see node_arena.hpp).
  */
 struct Node {
     public:
-        using child_p = std::unique_ptr<Node>;
+        using child_p = Node*;
     
         ElementType element;
-        std::vector<Attribute> attributes; // CSS attributes
+        std::pmr::vector<Attribute> attributes; // CSS attributes
         Node* parent;
-        std::vector<child_p> children;
+        std::pmr::vector<child_p> children;
     
         /**
          * @brief Constructs a Node object.
          * @param type The type of the node.
          * @param parent The parent node.
+         * @param resource The memory resource for the child and attribute lists (the owning arena).
          */
-        Node(ElementType type, Node* parent)
+        Node(ElementType type, Node* parent, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
         : element(type),
           parent(std::move(parent)),
-          children(std::vector<child_p>()),
-          attributes(std::vector<Attribute>()) {}
+          children(resource),
+          attributes(resource) {}
     
         virtual ~Node() = default;
 
@@ -90,21 +95,21 @@ struct Node {
          * @brief Adds a child node to the current node.
          * @param child The child node to add.
          */
-        void add_child(std::unique_ptr<Node> child) {
-            children.push_back(std::move(child));
+        void add_child(child_p child) {
+            children.push_back(child);
         }
 
         /**
-         * @brief Removes the last child node from the current node.
+         * @brief Removes the last child node from the current node. The node itself stays in its arena.
          * @return The removed child node, or std::nullopt if there are no children.
          */
-        std::optional<std::unique_ptr<Node>> remove_last_child()
+        std::optional<child_p> remove_last_child()
         {
             if (!children.empty())
             {
-                std::unique_ptr<Node> last_child = std::move(children.back());
+                child_p last_child = children.back();
                 children.pop_back();
-                return std::optional<std::unique_ptr<Node>>{std::move(last_child)};
+                return std::optional<child_p>{last_child};
             }
             return std::nullopt;
         }
@@ -131,20 +136,21 @@ struct Node {
 /**
  * @struct ContentNode
  * @brief A struct representing a content node in the parsing tree. It contains the content of the node and inherits
- * from Node. It also provides an accept method for traversal.
+ * from Node. The content is kept as a span of the input buffer whenever possible, so the input has to outlive the tree. It also provides an accept method for traversal.
  */
 struct ContentNode : public Node
 {
-    std::string content;
+    Text content; // usually a span of the input buffer, see Text
 
     /**
      * @brief Constructs a ContentNode object.
      * @param type The type of the node.
      * @param parent The parent node.
      * @param consumed The content of the node.
+     * @param resource The memory resource for the child and attribute lists (the owning arena).
      */
-    ContentNode(ElementType type, Node* parent, std::string&& consumed)
-    : Node(type, parent), content(std::move(consumed)) {}
+    ContentNode(ElementType type, Node* parent, Text&& consumed, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+    : Node(type, parent, resource), content(std::move(consumed)) {}
 
     /**
      * @brief Constructs a ContentNode object.
@@ -174,9 +180,10 @@ struct ImageNode : public Node
      * @param src The source of the image.
      * @param alt The alt text of the image.
      * @param title The title of the image.
+     * @param resource The memory resource for the child and attribute lists (the owning arena).
      */
-    ImageNode(Node* parent, std::string&& src, std::string&& alt, std::string&& title)
-    : Node(ElementType::ImageType, parent), src(std::move(src)), alt(std::move(alt)), title(std::move(title)) {}
+    ImageNode(Node* parent, std::string&& src, std::string&& alt, std::string&& title, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+    : Node(ElementType::ImageType, parent, resource), src(std::move(src)), alt(std::move(alt)), title(std::move(title)) {}
 
     /**
      * @brief Constructs an ImageNode object.
@@ -207,9 +214,10 @@ struct HyperlinkNode : public Node
      * @param href The href of the hyperlink.
      * @param displayed_alt The displayed text of the hyperlink.
      * @param title The title of the hyperlink.
+     * @param resource The memory resource for the child and attribute lists (the owning arena).
      */
-    HyperlinkNode(Node* parent, std::string&& href, std::string&& displayed_alt, std::string&& title)
-    : Node(ElementType::Hypertext, parent), href(std::move(href)), title(std::move(title)), displayed(std::move(displayed_alt)) {}
+    HyperlinkNode(Node* parent, std::string&& href, std::string&& displayed_alt, std::string&& title, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+    : Node(ElementType::Hypertext, parent, resource), href(std::move(href)), title(std::move(title)), displayed(std::move(displayed_alt)) {}
 
     /**
      * @brief Constructs a HyperlinkNode object.
@@ -0,0 +1,169 @@
+/**
+ * @file node_arena.hpp
+ * @brief A bump allocator owning all nodes of a parsing tree.
+ */
+
+#ifndef _NODE_ARENA_HPP
+#define _NODE_ARENA_HPP
+
+#include <memory>
+#include <memory_resource>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include "node.hpp"
+#include "alloc_accounting.hpp"
+
+/**
+ * @class NodeArena
+ * @brief A monotonic allocator for the nodes of one parsing tree and their child and attribute lists.
+ *
+ * Memory is handed out from large blocks by bumping an offset and is never freed piece by piece.
+ * `reset()` destroys all nodes in one linear pass and rewinds the blocks, which are kept for the next
+ * document, so an arena reused across documents stops allocating once it has grown to the largest one.
+ * The arena doubles as a `std::pmr::memory_resource`, so the child lists of its nodes live in it as well.
+ * It is not thread-safe: every thread building a tree needs its own arena (see `adopt`).
+ *
+ * @see TreeRoot
+ */
+class NodeArena : public std::pmr::memory_resource
+{
+public:
+    NodeArena() = default;
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    ~NodeArena()
+    {
+        destroy_nodes();
+    }
+
+    /**
+     * @brief Constructs a node in the arena. The arena is passed on as the node's memory resource.
+     * @param args The arguments of the node's constructor, without the memory resource.
+     * @return A pointer to the node, valid until the arena is reset.
+     */
+    template <typename NodeType, typename... Args>
+    NodeType* create(Args&&... args)
+    {
+        ALLOCATION_SITE(NodeCreation);
+        void* memory = allocate(sizeof(NodeType), alignof(NodeType));
+        NodeType* node = new (memory) NodeType(std::forward<Args>(args)..., this);
+        // a plain Node only holds lists allocated from the arena, so it does not need to be destroyed
+        if constexpr (!std::is_same_v<NodeType, Node>)
+            owning_nodes.push_back(node);
+        return node;
+    }
+
+    /**
+     * @brief Destroys all nodes and makes the memory available for the next tree.
+     */
+    void reset()
+    {
+        destroy_nodes();
+        adopted.clear();
+        current_block = 0;
+        offset = 0;
+    }
+
+    /**
+     * @brief Keeps another arena alive until this one is reset, e.g. one a subtree was built in on
+     * another thread before being grafted into the tree of this arena.
+     * @param other The arena to keep.
+     */
+    void adopt(std::shared_ptr<NodeArena> other)
+    {
+        adopted.push_back(std::move(other));
+    }
+
+    /**
+     * @brief Returns the number of bytes reserved from the system.
+     */
+    size_t capacity() const
+    {
+        size_t total = 0;
+        for (auto&& block : blocks)
+            total += block.size;
+        for (auto&& arena : adopted)
+            total += arena->capacity();
+        return total;
+    }
+
+private:
+    static constexpr size_t MIN_BLOCK_SIZE = 1 << 16;
+    static constexpr size_t MAX_BLOCK_SIZE = 1 << 22;
+
+    struct Block
+    {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t current_block = 0;  // the block being bumped into, the ones before it are full
+    size_t offset = 0;  // the first free byte of the current block
+    std::vector<Node*> owning_nodes;  // the nodes whose destructors have to run on reset
+    std::vector<std::shared_ptr<NodeArena>> adopted;
+
+    void destroy_nodes()
+    {
+        for (auto it = owning_nodes.rbegin(); it != owning_nodes.rend(); ++it)
+            (*it)->~Node();
+        owning_nodes.clear();
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        while (current_block < blocks.size())
+        {
+            size_t aligned = (offset + alignment - 1) & ~(alignment - 1);
+            if (aligned + bytes <= blocks[current_block].size)
+            {
+                offset = aligned + bytes;
+                return blocks[current_block].data.get() + aligned;
+            }
+            ++current_block;
+            offset = 0;
+        }
+
+        ALLOCATION_SITE(NodeCreation);
+        size_t size = blocks.empty() ? MIN_BLOCK_SIZE : std::min(blocks.back().size * 2, MAX_BLOCK_SIZE);
+        size = std::max(size, bytes + alignment);
+        blocks.push_back(Block{std::unique_ptr<std::byte[]>(new std::byte[size]), size});
+        current_block = blocks.size() - 1;
+        offset = 0;
+        return do_allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+/**
+ * @struct ArenaRelease
+ * @brief The deleter of a tree root: resets the arena the tree was built in, freeing the whole tree at once.
+ */
+struct ArenaRelease
+{
+    std::shared_ptr<NodeArena> arena;
+
+    void operator()(Node*) const
+    {
+        arena->reset();
+    }
+};
+
+/**
+ * @brief The root of a parsing tree together with the arena owning it. An arena holds one tree at a time,
+ * so the previous root has to be destroyed before the arena is used for the next document.
+ */
+using TreeRoot = std::unique_ptr<Node, ArenaRelease>;
+
+#endif
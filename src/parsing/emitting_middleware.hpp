@@ -12,6 +12,7 @@
 
 #include "../parsing_tree/tree_builder.hpp"
 #include "../error_handler.hpp"
+#include "../stats.hpp"
 #include <optional>
 
 /**
@@ -30,10 +31,10 @@ enum ParseWarningFlags
 
 /**
  * @class TableManager
- * @brief Manages table parsing and emits structured table data to the `TreeBuilder`.
+ * @brief Manages table parsing and emits structured table data to the `TokenSink` (usually the `TreeBuilder`).
  * 
  * The `TableManager` processes tokens related to tables, handles table-specific attributes,
- * and emits the table structure to the `TreeBuilder` on success or failure.
+ * and emits the table structure to the sink on success or failure.
  * 
  * @details
  * - Handles table rows, headers, and cells.
@@ -47,14 +48,26 @@ public:
     /**
      * @brief Constructs a `TableManager` object.
      * 
-     * @param builder_p Pointer to the `TreeBuilder` for emitting table data.
+     * @param sink The sink receiving the finished tables.
+     * @param arena The arena the tables are built in.
      * @param logger Pointer to the logger for error handling.
      */
-    TableManager(std::shared_ptr<TreeBuilder> builder_p, Logger* logger)
+    TableManager(TokenSink* sink, NodeArena* arena, Logger* logger)
     : table_root(nullptr),
-      builder(std::move(builder_p)),
+      arena(arena),
+      sink(sink),
       current(nullptr),
+      logger(logger),
       col_dims(0) {}
+
+    /**
+     * @brief Changes where tables are built and emitted to. Must not be called while a table is being parsed.
+     */
+    void set_target(TokenSink* sink, NodeArena* arena)
+    {
+        this->sink = sink;
+        this->arena = arena;
+    }
       
     /**
      * @brief Consumes a token and processes it based on its type.
@@ -63,7 +76,7 @@ public:
      * 
      * @throws std::runtime_error If the token type is not recognized or if the table structure is invalid.
      */
-    void consume_token(Token&& token)
+    void consume_token(Token token)
     {
         switch (token.element)
         {
@@ -73,9 +86,9 @@ public:
             {
                 if (table_root != nullptr)
                     throw std::runtime_error("Should have been nulled by now");
-                table_root = std::make_unique<Node>(ElementType::Table, nullptr);
+                table_root = arena->create<Node>(ElementType::Table, nullptr);
                 table_root->add_attribute(TableStyle);
-                current = table_root.get();
+                current = table_root;
             }
             else
                 throw std::runtime_error("You should not be here");
@@ -83,15 +96,15 @@ public:
         }
         case ElementType::Table_Row:
             if (token.type == TokenType::OpenToken)
-                create_new_node(std::move(token));
+                create_new_node(token);
             else
             {
                 if (col_dims != 0)  // not the header row, current is pointing to <tr>
                 {
                     for (size_t t = current->children.size(); t < col_dims; ++t)
                     {
-                        auto empty_child = std::make_unique<Node>(ElementType::Table_Cell, current);
-                        current->add_child(std::move(empty_child));
+                        auto empty_child = arena->create<Node>(ElementType::Table_Cell, current);
+                        current->add_child(empty_child);
                     }
                     current = current->parent;
                 }
@@ -107,7 +120,7 @@ public:
             break;
         case ElementType::Table_Head:
             if (token.type == OpenToken)
-                create_new_node(std::move(token));
+                create_new_node(token);
             else
                 current = current->parent;
             break;
@@ -115,7 +128,7 @@ public:
             if (token.type == OpenToken)
             {
                 if (current->children.size() < col_dims)
-                    create_new_node(std::move(token));
+                    create_new_node(token);
             }
             else
             {
@@ -128,19 +141,20 @@ public:
             if (current->element == ElementType::Table_Row)
                 break; // the current amount of data cell is greater than col_dim
             
-            auto node = std::make_unique<ContentNode>(ElementType::Content, current, std::move(token.content));
-            current->add_child(std::move(node));
+            auto node = arena->create<ContentNode>(ElementType::Content, current, token.to_text());
+            current->add_child(node);
             break;
         }
         case ElementType::Hypertext:
         {
             if (token.type == TokenType::OpenToken)
             {
-                auto new_node = std::make_unique<HyperlinkNode>(
-                    current, std::move(token.content), std::move(token.alt), std::move(token.title)
+                ALLOCATION_SITE(TokenConstruction);
+                auto new_node = arena->create<HyperlinkNode>(
+                    current, std::string(token.text), std::string(token.link->alt), std::string(token.link->title)
                 );
-                current = new_node.get();
-                current->parent->add_child(std::move(new_node));
+                current = new_node;
+                current->parent->add_child(new_node);
                 break;
             }
             else
@@ -151,7 +165,7 @@ public:
         case ElementType::Span:
         case ElementType::Codeblock:
             if (token.type == TokenType::OpenToken)
-                create_new_node(std::move(token));
+                create_new_node(token);
             else
                 current = current->parent;
             break;
@@ -171,13 +185,13 @@ public:
     }
 
     /**
-     * @brief Emits the table structure to the `TreeBuilder` on success.
+     * @brief Emits the table structure to the sink on success.
      * 
-     * This method appends the table root to the tree builder and resets the table root.
+     * This method appends the table root to the sink and resets the table root.
      */
     void emit_on_success()
     {
-        builder->append_subtree(std::move(table_root));
+        sink->append_subtree(table_root);
         table_root = nullptr;
     }
 
@@ -190,11 +204,11 @@ public:
     {
         if (table_root == nullptr)
         {
-            logger->log_error("Table root is null when emitting.");
+            LOG_ERROR(logger, "Table root is null when emitting.");
             throw std::runtime_error("invalid emitting on failure");
         }
         //print_tree();
-        std::optional<std::unique_ptr<Node>> last_row_p = table_root->remove_last_child();
+        std::optional<Node*> last_row_p = table_root->remove_last_child();
         if (!last_row_p.has_value())
             return;
 
@@ -203,7 +217,7 @@ public:
             emit_on_success();
 
         // emit the last row as paragraph
-        emit_row_as_paragraph(std::move(*last_row_p));
+        emit_row_as_paragraph(*last_row_p);
         table_root = nullptr;
         col_dims = 0;
     }
@@ -217,17 +231,28 @@ public:
     {
         return col_dims;
     }
+
+    /**
+     * @brief Sets the number of columns remembered from a preceding table.
+     * 
+     * @param dims The number of columns.
+     */
+    void set_col_dims(size_t dims)
+    {
+        col_dims = dims;
+    }
 private:
-    std::unique_ptr<Node> table_root;
-    std::shared_ptr<TreeBuilder> builder;
+    Node* table_root;
+    NodeArena* arena;
+    TokenSink* sink;
     Node* current;
     Logger* logger;
     // current table state
     size_t col_dims;
 
-    void create_new_node(Token&& token)
+    void create_new_node(Token token)
     {
-        auto node = std::make_unique<Node>(token.element, current);
+        auto node = arena->create<Node>(token.element, current);
         if (token.element == ElementType::Table_Row)
             node->add_attribute(Attribute::TableRow);
         else if (token.element == ElementType::Table_Head)
@@ -235,39 +260,39 @@ private:
         else if (token.element == ElementType::Table_Cell)
             node->add_attribute(Attribute::TableCell);
 
-        current = node.get();
-        current->parent->add_child(std::move(node));
+        current = node;
+        current->parent->add_child(node);
     }
 
     /**
      * @brief A method called when parsing failed and the last row of the parsing tree is invalid,
      * hence can be emitted as in a paragraph element.
      */
-    void emit_row_as_paragraph(std::unique_ptr<Node> row_p)
+    void emit_row_as_paragraph(Node* row_p)
     {
         if (row_p->children.empty())
             return;
         row_p->element = ElementType::Paragraph;
 
-        std::vector<std::unique_ptr<Node>> new_children;
+        std::pmr::vector<Node*> new_children(arena);
         for (auto& td_node : row_p->children)
         {
             // Transfer the children of the <td> element to the new_children vector
-            new_children.push_back(std::make_unique<ContentNode>(ElementType::Content, row_p.get(), "|"));
+            new_children.push_back(arena->create<ContentNode>(ElementType::Content, row_p, Text::span_of("|")));
             for (auto& child : td_node->children)
             {
-                new_children.push_back(std::move(child));
+                new_children.push_back(child);
             }
         }
         row_p->children = std::move(new_children);
 
-        builder->append_subtree(std::move(row_p));
+        sink->append_subtree(row_p);
     }
 
     void print_tree() const
     {
         std::stack<std::pair<Node*, size_t>> node_stack;
-        node_stack.push(std::make_pair<Node*, size_t>(table_root.get(), 0));
+        node_stack.push({table_root, 0});
         while (!node_stack.empty())
         {
             std::pair<Node*, size_t> popped = node_stack.top();
@@ -277,7 +302,7 @@ private:
 
             for (auto it=popped.first->children.rbegin(); it != popped.first->children.rend(); ++it)
             {
-                node_stack.push(std::make_pair<Node*, size_t>((*it).get(), popped.second + 1));
+                node_stack.push(std::make_pair(*it, popped.second + 1));
             }
         }
     }
@@ -286,70 +311,101 @@ private:
 
 /**
  * @class Token_Emitter
- * @brief Middleware between `Md_Parser` and `TreeBuilder`.
+ * @brief Middleware between `Md_Parser` and a `TokenSink`, the `TreeBuilder` unless another sink is set.
  * 
  * The `Token_Emitter` handles token emission and delegates table-specific tokens to the `TableManager`.
- * It ensures proper communication between the parser and the tree builder.
+ * It ensures proper communication between the parser and the sink.
  * 
  * @details
  * - Manages table parsing using the `TableManager`.
- * - Emits non-table tokens directly to the `TreeBuilder`.
+ * - Emits non-table tokens directly to the sink.
+ * - Keeps the elements opened on the sink, which the parser asks about (see `fetch_current_element`).
  * 
  * @see TableManager
+ * @see TokenSink
  * @see TreeBuilder
  */
 class Token_Emitter
 {
 public:
     Token_Emitter(std::shared_ptr<TreeBuilder> builder_p, Logger* logger)
-    : table_manager(std::make_unique<TableManager>(std::shared_ptr<TreeBuilder>(builder_p), logger)),
+    : table_manager(std::make_unique<TableManager>(builder_p.get(), builder_p->get_arena(), logger)),
       builder(std::shared_ptr(builder_p)),
+      sink(builder_p.get()),
       logger(logger),
       table_parsing_flag(false) {}
 
-    void emit_token(Token&& to_emit) 
+    void emit_token(Token to_emit)
     {
+        if (stats != nullptr)
+            stats->count_token(to_emit.type);
+        if (to_emit.type != TokenType::EOF_Token)
+            check_root_open();
         if (table_parsing_flag)
         {
-            logger->log_info("Emitting " + element_to_html_name[to_emit.element] + " to table builder.");
-            table_manager->consume_token(std::move(to_emit));
+            LOG_INFO(logger, "Emitting " + element_to_html_name[to_emit.element] + " to table builder.");
+            PhaseTimer timer(stats, Tables);
+            table_manager->consume_token(to_emit);
             return;
         }
         
         if (to_emit.element == ElementType::Table)
         {
             table_parsing_flag = true;
-            logger->log_info("Table parsing has started.");
-            logger->log_info("Emitting " + element_to_html_name[to_emit.element] + " to table builder.");
-            table_manager->consume_token(std::move(to_emit));
+            LOG_INFO(logger, "Table parsing has started.");
+            LOG_INFO(logger, "Emitting " + element_to_html_name[to_emit.element] + " to table builder.");
+            PhaseTimer timer(stats, Tables);
+            table_manager->consume_token(to_emit);
             return;
         }
 
-        logger->log_info("Emitting " + element_to_html_name[to_emit.element] + " to tree builder.");
-        builder->consume_token(std::move(to_emit));
+        LOG_INFO(logger, "Emitting " + element_to_html_name[to_emit.element] + " to tree builder.");
+        PhaseTimer timer(stats, TreeBuilding);
+        if (to_emit.type == TokenType::OpenToken)
+            open_elements.push_back(to_emit.element);
+        else if (to_emit.type == TokenType::CloseToken && !open_elements.empty())
+            open_elements.pop_back();
+        else if (to_emit.type == TokenType::CloseToken)
+        {
+            // closing the document root, nothing but the end of the document may follow
+            root_closed = true;
+            if (sink != builder.get())
+                return;
+        }
+        sink->consume_token(to_emit);
+        builder->release_blocks();
     }
 
     void handle_flag(ParseWarningFlags flag)
     {
+        PhaseTimer timer(stats, Tables);
         switch (flag)
         {
         case TableFailed:
-            logger->log_info("Table parsing has ended");
+            LOG_INFO(logger, "Table parsing has ended");
             table_manager->emit_on_failure();
             table_parsing_flag = false;
+            release_table();
             break;
         case TableSuccess:
-            logger->log_info("Table parsing has ended");
+            LOG_INFO(logger, "Table parsing has ended");
             table_manager->emit_on_success();
             table_parsing_flag = false;
+            release_table();
         default:
             break;
         }
     }
 
+    /**
+     * @brief Returns the innermost element open on the sink (outside of the table being parsed),
+     * DOCSTART if there is none.
+     * @throws std::runtime_error If the document root has been closed.
+     */
     ElementType fetch_current_element()
     {
-        return builder->get_current_element();
+        check_root_open();
+        return open_elements.empty() ? ElementType::DOCSTART : open_elements.back();
     }
 
     std::shared_ptr<TreeBuilder> get_builder()
@@ -362,23 +418,105 @@ public:
         builder->print_tree();
     }
 
+    void build_flat(FlatTree* target)
+    {
+        builder->build_flat(target);
+    }
+
+    void set_block_handler(TreeBuilder::BlockHandler handler)
+    {
+        builder->set_block_handler(std::move(handler));
+    }
+
+    /**
+     * @brief Sends the tokens to `target` instead of the tree builder, which then stays empty. Tables are built
+     * in an arena of their own, freed after each table. Has to be called before the first token is emitted.
+     * @param target The sink, which has to outlive the emitter.
+     */
+    void set_sink(TokenSink* target)
+    {
+        sink = target;
+        table_arena = std::make_unique<NodeArena>();
+        table_manager->set_target(target, table_arena.get());
+    }
+
+    /**
+     * @brief Tells the sink that the document has ended. A sink other than the tree builder gets
+     * the elements still open closed first.
+     */
+    void finish()
+    {
+        if (sink != builder.get())
+        {
+            while (!open_elements.empty())
+            {
+                sink->consume_token(Token(TokenType::CloseToken, open_elements.back()));
+                open_elements.pop_back();
+            }
+        }
+        sink->end_document();
+    }
+
     void add_attribute(Attribute&& attr)
     {
         if (table_parsing_flag)
             table_manager->add_attribute(std::move(attr));
         else
-            builder->add_attribute(std::move(attr));
+            sink->add_attribute(attr);
     }
 
     size_t get_col_dims()
     {
         return table_manager->get_col_dims();
     }
+
+    void set_col_dims(size_t dims)
+    {
+        table_manager->set_col_dims(dims);
+    }
+
+    bool is_parsing_table() const
+    {
+        return table_parsing_flag;
+    }
+
+    void set_stats(Stats* stats)
+    {
+        this->stats = stats;
+    }
 private:
     std::shared_ptr<TreeBuilder> builder;
+    TokenSink* sink;
+    std::unique_ptr<NodeArena> table_arena;  // only with a sink other than the tree builder
     std::unique_ptr<TableManager> table_manager;
+    std::vector<ElementType> open_elements;
     Logger* logger;
     bool table_parsing_flag;
+    bool root_closed = false;  // whether the parser has closed the document root
+    Stats* stats = nullptr;
+
+    /**
+     * @throws std::runtime_error If the document root has been closed, as the tree builder would.
+     */
+    void check_root_open()
+    {
+        if (root_closed)
+        {
+            LOG_ERROR(logger, "Current is null. The error is on our side, we're working on it.");
+            throw std::runtime_error("Error during tree parsing");
+        }
+    }
+
+    /**
+     * @brief Frees the nodes of the table which has just been emitted.
+     */
+    void release_table()
+    {
+        if (table_arena != nullptr)
+            table_arena->reset();
+        else
+            builder->release_blocks();
+    }
 };
 
 
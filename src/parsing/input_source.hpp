@@ -0,0 +1,143 @@
+/**
+ * @file input_source.hpp
+ * @brief Contiguous, read-only access to the markdown document.
+ */
+
+#ifndef _INPUT_SOURCE_HPP
+#define _INPUT_SOURCE_HPP
+
+#include <string>
+#include <string_view>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define INPUT_SOURCE_POSIX 1
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/**
+ * @class InputSource
+ * @brief Holds the whole input document as one contiguous block of bytes.
+ *
+ * Regular files are memory-mapped, so the parser reads straight from the page cache. Anything
+ * that cannot be mapped (pipes, character devices, empty files, non-POSIX systems) is read
+ * into an owned buffer in large chunks instead. Either way, `view()` hands out a single
+ * contiguous span which stays valid for the lifetime of the `InputSource`.
+ *
+ * @see Md_Parser
+ */
+class InputSource
+{
+public:
+    InputSource() = default;
+
+    InputSource(const InputSource&) = delete;
+    InputSource& operator=(const InputSource&) = delete;
+
+    ~InputSource()
+    {
+        close();
+    }
+
+    /**
+     * @brief Opens the document at the given path.
+     *
+     * @param path The path to the markdown document.
+     * @return true if the document could be opened and read, false otherwise.
+     */
+    bool open(const std::string& path)
+    {
+        close();
+#ifdef INPUT_SOURCE_POSIX
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+        {
+            void* addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED)
+            {
+                madvise(addr, info.st_size, MADV_SEQUENTIAL);
+                mapped = static_cast<const char*>(addr);
+                mapped_size = info.st_size;
+                ::close(fd);
+                return true;
+            }
+        }
+
+        bool success = read_fd(fd);
+        ::close(fd);
+        return success;
+#else
+        std::ifstream stream(path, std::ios::binary);
+        if (stream.fail())
+            return false;
+        char chunk[READ_CHUNK_SIZE];
+        while (stream.read(chunk, sizeof(chunk)) || stream.gcount() > 0)
+            buffer.append(chunk, stream.gcount());
+        return true;
+#endif
+    }
+
+    /**
+     * @brief Returns the whole document as a contiguous span of bytes.
+     */
+    std::string_view view() const
+    {
+        if (mapped != nullptr)
+            return std::string_view(mapped, mapped_size);
+        return std::string_view(buffer);
+    }
+
+    /**
+     * @brief Returns whether the document is memory-mapped (as opposed to buffered).
+     */
+    bool is_mapped() const
+    {
+        return mapped != nullptr;
+    }
+
+private:
+    static constexpr size_t READ_CHUNK_SIZE = 1 << 16;
+
+    const char* mapped = nullptr; /**< The start of the mapping, nullptr when buffered. */
+    size_t mapped_size = 0;
+    std::string buffer; /**< The fallback storage for inputs which cannot be mapped. */
+
+    void close()
+    {
+#ifdef INPUT_SOURCE_POSIX
+        if (mapped != nullptr)
+            munmap(const_cast<char*>(mapped), mapped_size);
+#endif
+        mapped = nullptr;
+        mapped_size = 0;
+        buffer.clear();
+    }
+
+#ifdef INPUT_SOURCE_POSIX
+    bool read_fd(int fd)
+    {
+        char chunk[READ_CHUNK_SIZE];
+        while (true)
+        {
+            ssize_t count = ::read(fd, chunk, sizeof(chunk));
+            if (count == 0)
+                return true;
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count < 0)
+                return false;
+            buffer.append(chunk, count);
+        }
+    }
+#endif
+};
+
+#endif
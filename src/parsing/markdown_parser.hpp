@@ -6,65 +6,145 @@
 #ifndef _MARKDOWN_PARSER_HPP
 #define _MARKDOWN_PARSER_HPP
 
-#include <fstream>
+#include <string_view>
+#include <vector>
 #include "state.hpp"
 #include "state_handlers.hpp"
 #include "../error_handler.hpp"
 #include "parser_interface.hpp"
+#include "input_source.hpp"
+#include "streamed_input.hpp"
+#include "text_scanner.hpp"
+#include "../stats.hpp"
+#ifdef STATE_PROFILER
+#include <chrono>
+#include "state_profiler.hpp"
+#endif
+
+/**
+ * @struct CarriedState
+ * @brief The part of the parsing context which is not reset between top-level blocks, yet influences
+ * how later blocks are parsed. Parsing a document in segments (see ParallelParser) has to hand it over
+ * from one segment to the next.
+ */
+struct CarriedState
+{
+    bool is_image = false;  // stale value of Context::is_image, read by links inside table cells
+    size_t col_dims = 0;  // the column count of the last table, kept by TableManager
+    std::vector<State> returns;  // the states left on the return stack, from the bottom to the top
+
+    bool operator==(const CarriedState& other) const
+    {
+        return is_image == other.is_image && col_dims == other.col_dims && returns == other.returns;
+    }
+    bool operator!=(const CarriedState& other) const
+    {
+        return !(*this == other);
+    }
+};
 
 /**
  * @class Md_Parser
  * @brief The main class for Markdown parsing.
  * 
- * The `Md_Parser` class is responsible for managing the parsing process. It reads the input
- * Markdown file, updates the `Context`, and delegates character processing to the appropriate
+ * The `Md_Parser` class is responsible for managing the parsing process. It walks the contiguous
+ * bytes of an `InputSource`, updates the `Context`, and delegates character processing to the appropriate
  * state handler. The emitted tokens are used to construct a parsing tree.
  * 
  * @details
  * - Implements the **State Pattern** through state handlers.
- * - Emits tokens to the `TreeBuilder` for constructing the parsing tree.
+ * - Emits tokens to the `TreeBuilder` for constructing the parsing tree, or to another `TokenSink` (see `set_sink`).
  * - Handles special cases like escape sequences and unexpected characters.
  * 
  * @see Context
  * @see TreeBuilder
+ * @see InputSource
  */
 class Md_Parser : public AbstractParser
 {
 public:
     /**
-     * @param md_stream A reference to an already established stream of the markdown document.parse_document
+     * @param source An already opened markdown document. It has to outlive the parser.
+     * @param logger A pointer to the overarching Logger instance.
+     * @param arena The arena to build the tree in, e.g. one reused across documents. A new one if null.
+     */
+    Md_Parser(const InputSource& source, Logger* logger, std::shared_ptr<NodeArena> arena = nullptr)
+    : Md_Parser(source.view(), logger, 1, std::move(arena)) {}
+
+    /**
+     * @param source A markdown document still being read (see StreamedInput). Parsing waits for the bytes which
+     * have not been read yet. It has to outlive the parser.
+     * @param logger A pointer to the overarching Logger instance.
+     * @param arena The arena to build the tree in, e.g. one reused across documents. A new one if null.
+     */
+    Md_Parser(const StreamedInput& source, Logger* logger, std::shared_ptr<NodeArena> arena = nullptr)
+    : Md_Parser(source.view(), logger, 1, std::move(arena))
+    {
+        feed = &source;
+    }
+
+    /**
+     * @param input The markdown text to parse, e.g. a segment of a larger document. It has to outlive the parser
+     * and the produced tree.
      * @param logger A pointer to the overarching Logger instance.
+     * @param first_line The line number of the first line of input (used in warnings).
+     * @param arena The arena to build the tree in, e.g. one reused across documents. A new one if null.
      */
-    Md_Parser(std::ifstream& md_stream, Logger* logger)
-    : md_stream(md_stream),
-      context(logger),
-      curr_line(1),
+    Md_Parser(std::string_view input, Logger* logger, size_t first_line = 1, std::shared_ptr<NodeArena> arena = nullptr)
+    : input(input),
+      context(logger, arena != nullptr ? std::move(arena) : std::make_shared<NodeArena>()),
+      curr_line(first_line),
+      fast_skip(true),
+      ended_at_boundary(false),
       logger(logger) {}
 
     /**
-     * @brief The starting point for markdown parsing. The method reads the input document char by char, changes
+     * @brief The starting point for markdown parsing. The method walks the input document char by char, changes
      * its context and calls the corresponding state handler. This handler processes the char and changes
      * the context appropriately. The handlers can emit tokens to a tree builder which creates a parsing tree.
      * @param print_tree A bool for printing the constructed tree to the output (meant for debugging).
-     * @return A unique pointer to the root of a parsing tree.
+     * @return The root of a parsing tree, owning the arena it is allocated in.
+     * @throws std::runtime_error If a StreamedInput could not be read whole.
      */
-    virtual std::unique_ptr<Node> parse_document(bool print_tree = false) override
+    virtual TreeRoot parse_document(bool print_tree = false) override
     {
-        EnumArithmetic enumOp;
         char next;
-        int next_flag;
         reset_context();
+        PhaseTimer timer(stats, Parse);
+        size_t available = feed != nullptr ? feed->available() : input.size();  // the bytes which may be read
 
-        while (true)
+        for (size_t pos = 0; ; ++pos)
         {
-            int next_flag = md_stream.get();
-            if (next_flag != -1)
-                next = (char) next_flag;
+            if (pos >= available && available < input.size())
+                available = feed->wait_beyond(pos);
+            // Plain text in State::Data is only appended, so the whole run is consumed at once
+            if (fast_skip && context.state == State::Data && !context.is_escaped && !context.consumed.empty())
+            {
+                size_t run = text_scanner::find_special(input.data() + pos, available - pos);
+                if (run != 0)
+                {
+#ifdef STATE_PROFILER
+                    profile.bytes[State::Data] += run;
+#endif
+                    context.consumed.set_cursor(pos);
+                    context.consumed.append_run(run);
+                    context.newline_counter = 0;
+                    pos += run;
+                    if (pos >= available && available < input.size())
+                        available = feed->wait_beyond(pos);
+                }
+            }
+
+            if (pos < available)
+                next = input[pos];
             else
             {
+                if (!context.EOF_Reached)
+                    ended_at_boundary = at_block_boundary();
                 next = '\n';
                 context.EOF_Reached = true;
             }
+            context.consumed.set_cursor(pos);
             if (next == '\n')
                 ++curr_line;
             // Handle escaping
@@ -85,16 +165,17 @@ public:
             }
 
             // Consume char
-            auto&& [state_key, handler] = state_handlers[context.state];
-            if (state_key != context.state)
-            {
-                logger->log_error("State key found in state_handlers and state in context do not match");
-                throw std::runtime_error("State error");
-            }
-            handler(context, next);
+#ifdef STATE_PROFILER
+            State from = context.state;
+            auto start = std::chrono::steady_clock::now();
+            state_handlers[context.state].second(context, next);
+            profile.record_call(from, context.state, std::chrono::steady_clock::now() - start);
+#else
+            state_handlers[context.state].second(context, next);
+#endif
             if (!context.warning_msg.empty())
             {
-                logger->log_warning(context.warning_msg, curr_line);
+                LOG_WARNING(logger, context.warning_msg, curr_line);
                 context.warning_msg.clear();
             }
 
@@ -102,15 +183,124 @@ public:
             if (context.newline_counter != 0 && next != '\n') { context.newline_counter = 0; }
         }
         
+        if (feed != nullptr && feed->failed())
+            throw std::runtime_error("the input could not be read whole");
+        context.emitter->finish();
+#ifdef STATE_PROFILER
+        StateProfile::add_to_global(profile);
+#endif
         if (print_tree) { context.emitter->print_tree(); }
         return context.emitter->get_builder()->get_root();
     }
 
+    /**
+     * @brief Parses the document into a FlatTree instead of a tree of nodes (see TreeBuilder::build_flat).
+     * Like `parse_document`, it can be called only once per parser.
+     * @return The flat parsing tree. Its content spans point into the input.
+     */
+    FlatTree parse_flat_document()
+    {
+        FlatTree tree;
+        context.emitter->build_flat(&tree);
+        parse_document();
+        return tree;
+    }
+
+    /**
+     * @brief Streams the document: every top-level block is handed over to `handler` as soon as it has been parsed
+     * and freed afterwards (see TreeBuilder::set_block_handler), so the tree never holds more than one block.
+     * Has to be called before `parse_document`, which then returns an empty root.
+     * @param handler The function receiving the blocks, in document order.
+     */
+    void set_block_handler(TreeBuilder::BlockHandler handler)
+    {
+        context.emitter->set_block_handler(std::move(handler));
+    }
+
+    /**
+     * @brief Sends the document to `sink` as a stream of tokens instead of building a tree (see TokenSink),
+     * so that only the open elements (and a table until it has ended) are kept in memory.
+     * Has to be called before `parse_document`, which then returns an empty root.
+     * @param sink The receiver of the tokens. It has to outlive the parser.
+     */
+    void set_sink(TokenSink* sink)
+    {
+        context.emitter->set_sink(sink);
+    }
+
+    /**
+     * @brief Collects timing and token counts into `stats` while parsing (see Stats). Off by default.
+     */
+    void set_stats(Stats* stats)
+    {
+        this->stats = stats;
+        context.emitter->set_stats(stats);
+        if (stats != nullptr)
+            stats->tokens_counted = true;
+    }
+
+    /**
+     * @brief Turns the vectorized skipping of plain text on or off (it is on by default).
+     * Meant for benchmarking, the produced tree is the same either way.
+     */
+    void set_fast_skip(bool enabled)
+    {
+        fast_skip = enabled;
+    }
+
+    /**
+     * @brief Sets the state carried over from the text preceding the input (see CarriedState).
+     * @param carried The carried state.
+     * @param unknown_returns If set, carried.returns is ignored and the return stack is treated as
+     * bottomless instead (see ReturnStateStack::set_bottomless).
+     */
+    void set_carried_state(const CarriedState& carried, bool unknown_returns = false)
+    {
+        initial_state = carried;
+        bottomless_returns = unknown_returns;
+    }
+
+    /**
+     * @brief Returns the state to carry over to the text following the input. Valid after parse_document.
+     * With a bottomless return stack, returns only holds the entries pushed while parsing the input.
+     */
+    CarriedState get_carried_state() const
+    {
+        return CarriedState{context.is_image, context.emitter->get_col_dims(), context.return_stack->get_states()};
+    }
+
+    /**
+     * @brief Returns the return stack, e.g. to inspect how far below its bottom a bottomless stack reached.
+     */
+    const ReturnStateStack& get_return_stack() const
+    {
+        return *context.return_stack;
+    }
+
+    /**
+     * @brief Returns whether the whole input has been consumed without leaving anything open (no unfinished
+     * block, no pending text), i.e. whether parsing text following the input with a fresh
+     * parser gives the same result as parsing everything at once. Valid after parse_document.
+     */
+    bool ended_at_block_boundary() const
+    {
+        return ended_at_boundary;
+    }
+
 private:
     size_t curr_line;
-    std::ifstream& md_stream;
+    bool fast_skip;
+    bool ended_at_boundary;
+    std::string_view input;
+    const StreamedInput* feed = nullptr;  // set when the input is still being read
     Context context;
+    CarriedState initial_state;
+    bool bottomless_returns = false;
     Logger* logger;
+    Stats* stats = nullptr;
+#ifdef STATE_PROFILER
+    StateProfile profile;
+#endif
 
     void reset_context()
     {
@@ -121,11 +311,35 @@ private:
         context.blockquote_in_list = false;
         context.src.clear();
         context.alt.clear();
-        context.consumed.clear();
+        context.consumed.bind(input);
         context.EOF_Reached = false;
         context.is_escaped = false;
         context.state = State::Data;
-        context.is_image = false;
+        context.is_image = initial_state.is_image;
+        context.emitter->set_col_dims(initial_state.col_dims);
+        context.return_stack->set_bottomless(bottomless_returns);
+        if (!bottomless_returns)
+        {
+            for (State state : initial_state.returns)
+                context.return_stack->push(state);
+        }
+#ifdef STATE_PROFILER
+        context.return_stack->set_profile(&profile);  // the carried entries are not counted
+#endif
+    }
+
+    bool at_block_boundary()
+    {
+        return context.state == State::Data
+            && !context.is_escaped
+            && context.consumed.empty()
+            && context.counter == 0
+            && context.indent_level == 0
+            && !context.blockquote_in_list
+            && context.src.empty()
+            && context.alt.empty()
+            && !context.emitter->is_parsing_table()
+            && context.emitter->fetch_current_element() == ElementType::DOCSTART;
     }
 
     void handle_escape_sequence(char next)
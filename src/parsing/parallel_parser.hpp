@@ -0,0 +1,331 @@
+/**
+ * @file parallel_parser.hpp
+ * @brief Parsing a large document on several threads at once.
+ */
+
+#ifndef _PARALLEL_PARSER_HPP
+#define _PARALLEL_PARSER_HPP
+
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include <thread>
+#include <exception>
+#include "markdown_parser.hpp"
+#include "input_source.hpp"
+#include "parser_interface.hpp"
+#include "../error_handler.hpp"
+#include "../stats.hpp"
+#include "../parsing_tree/tree_builder.hpp"
+
+/**
+ * @brief Documents (or segments) smaller than this are not split any further.
+ */
+#ifndef PARALLEL_MIN_SEGMENT_SIZE
+#define PARALLEL_MIN_SEGMENT_SIZE (1 << 16)
+#endif
+
+/**
+ * @struct Segment
+ * @brief A range of the input document which can be parsed on its own.
+ */
+struct Segment
+{
+    size_t begin;
+    size_t end;
+    size_t first_line;
+};
+
+/**
+ * @brief Splits a document into at most `count` segments of roughly equal size.
+ *
+ * A segment boundary is placed at the start of a line of plain text which follows an empty line and lies
+ * outside a fenced code block. The paragraph before it has to be closed as well: the parser opens
+ * a paragraph at the end of its first line and closes it at the second newline following another line,
+ * so either two empty lines precede the boundary, or one empty line preceded by at least two lines of
+ * plain text. Lists, tables, blockquotes, headings and lines starting with an inline element are not
+ * counted as plain text. Such places are where the parser is normally back at the top level of
+ * the document, though this is only a heuristic: ParallelParser verifies every boundary after parsing.
+ *
+ * @param input The whole document.
+ * @param count The desired number of segments.
+ * @param min_size The minimum size of a segment.
+ * @return Consecutive segments covering the whole document.
+ */
+std::vector<Segment> find_segments(std::string_view input, size_t count, size_t min_size = PARALLEL_MIN_SEGMENT_SIZE)
+{
+    std::vector<Segment> segments;
+    size_t target = count == 0 ? input.size() : std::max(min_size, input.size() / count);
+    size_t begin = 0;
+    size_t first_line = 1;
+    size_t line = 1;
+    bool in_fence = false;
+    size_t empty_lines = 0;  // the number of empty lines right before the current one
+    size_t text_lines = 0;  // the number of lines of plain text before them
+    bool block_before_empty = false;  // whether the line before the empty line(s) was not plain text
+
+    auto is_plain_text = [](std::string_view text) {
+        char c = text[0];
+        return !(c == ' ' || c == '\t' || c == '|' || c == '>' || c == '-' || c == '*' || c == '+' || c == '#'
+            || c == '[' || c == '!' || c == '`' || c == '\\' || std::isdigit(static_cast<unsigned char>(c)));
+    };
+
+    size_t pos = 0;
+    while (pos < input.size())
+    {
+        size_t line_end = input.find('\n', pos);
+        if (line_end == std::string_view::npos)
+            line_end = input.size();
+        std::string_view text = input.substr(pos, line_end - pos);
+
+        if (text.empty())
+        {
+            ++empty_lines;
+        }
+        else
+        {
+            bool plain = is_plain_text(text) && text.find("```") == std::string_view::npos;
+            bool closed = empty_lines >= 2 || (empty_lines == 1 && text_lines >= 2);
+            if (plain && closed && !in_fence && !block_before_empty
+                && pos - begin >= target && input.size() - pos >= min_size)
+            {
+                segments.push_back(Segment{begin, pos, first_line});
+                begin = pos;
+                first_line = line;
+            }
+            for (size_t fence = text.find("```"); fence != std::string_view::npos; fence = text.find("```", fence + 3))
+                in_fence = !in_fence;
+            if (empty_lines != 0)
+                text_lines = 0;
+            text_lines = plain && !in_fence ? text_lines + 1 : 0;
+            block_before_empty = !plain || in_fence;
+            empty_lines = 0;
+        }
+
+        pos = line_end + 1;
+        ++line;
+    }
+    segments.push_back(Segment{begin, input.size(), first_line});
+    return segments;
+}
+
+/**
+ * @class ParallelParser
+ * @brief Parses a document in segments on several threads and grafts the resulting trees together.
+ *
+ * The document is split by `find_segments`. Every segment gets its own `Md_Parser` (and with it its
+ * own `Context` and `TreeBuilder`) running on its own thread. The top-level children of the segment
+ * trees are then moved, in order, under a single DOCSTART root. Instead of `parse_document`, the steps
+ * `split`, `parse_segment_at` and `assemble` can be run separately, e.g. by a scheduler shared with other work.
+ *
+ * The result is always the same tree the sequential `Md_Parser` produces. A segment boundary is kept
+ * only if the parser of the preceding segment ended at a block boundary; otherwise the two segments are
+ * parsed again as one. A segment which was parsed with a different `CarriedState` than the one its
+ * predecessor left behind is parsed again as well. Since the segments after the first are parsed before
+ * it is known what their predecessors leave on the return stack, they are parsed with a bottomless stack
+ * and only kept if every entry they reached below its bottom is a State::Data entry of the actual stack.
+ *
+ * With `set_stats`, every segment is parsed with Stats of its own, which are added to the given ones by
+ * `assemble` for the segments that are kept. The parse time is then the sum over the segments, not the
+ * wall time of parsing them all; the parses which are thrown away are not counted.
+ *
+ * @see Md_Parser
+ * @see find_segments
+ */
+class ParallelParser : public AbstractParser
+{
+public:
+    /**
+     * @param source An already opened markdown document. It has to outlive the parser and the tree.
+     * @param logger A pointer to the overarching Logger instance.
+     * @param threads The number of threads (and segments) to use.
+     */
+    ParallelParser(const InputSource& source, Logger* logger, size_t threads)
+    : input(source.view()),
+      logger(logger),
+      threads(threads) {}
+
+    /**
+     * @brief Collects the times and counts of parsing into `stats` (see the class description), or stops if null.
+     * Has to be called before `split`.
+     */
+    void set_stats(Stats* stats)
+    {
+        this->stats = stats;
+        if (stats != nullptr)
+            stats->tokens_counted = true;
+    }
+
+    virtual TreeRoot parse_document(bool print_tree = false) override
+    {
+        size_t count = split();
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < count; ++i)
+            workers.emplace_back([this, i] { parse_segment_at(i); });
+        parse_segment_at(0);
+        for (auto&& worker : workers)
+            worker.join();
+
+        TreeRoot root = assemble();
+        if (print_tree) { TreeBuilder::print_tree(root.get()); }
+        return root;
+    }
+
+    /**
+     * @brief Splits the document into segments (see find_segments), to be parsed by `parse_segment_at`.
+     * @return The number of segments.
+     */
+    size_t split()
+    {
+        segments = find_segments(input, threads);
+        results = std::vector<SegmentResult>(segments.size());
+        LOG_INFO(logger, "Parsing in " + std::to_string(segments.size()) + " segments.");
+        return segments.size();
+    }
+
+    /**
+     * @brief Parses a single segment on its own. Different segments can be parsed on different threads at once.
+     * @param i The index of the segment, less than the number returned by `split`.
+     */
+    void parse_segment_at(size_t i)
+    {
+        results[i] = parse_segment(segments[i], segments[i], CarriedState(), i != 0);
+    }
+
+    /**
+     * @brief Joins the trees of the parsed segments, parsing segments again where their boundary did not hold.
+     * Has to be called once all segments have been parsed.
+     */
+    TreeRoot assemble()
+    {
+        TreeRoot root = nullptr;
+        CarriedState carried;
+        size_t i = 0;
+        while (i < segments.size())
+        {
+            size_t last = i;
+            SegmentResult result = std::move(results[i]);
+            if (!fits(result, carried))
+                result = parse_segment(segments[i], segments[last], carried);
+            else if (result.speculative)
+                result.carried_out.returns = stack_after(carried.returns, result);
+            while (!result.at_boundary && last + 1 < segments.size())
+            {
+                ++last;
+                LOG_INFO(logger, "Merging segment " + std::to_string(last) + " into its predecessor.");
+                result = parse_segment(segments[i], segments[last], carried);
+            }
+            result.log->replay(*logger);
+            if (result.error)  // the sequential parser would have failed as well
+                std::rethrow_exception(result.error);
+
+            if (stats != nullptr)
+                stats->merge(*result.stats);
+            {
+                PhaseTimer timer(stats, Parse);
+                graft(root, std::move(result.root));
+            }
+            carried = result.carried_out;
+            i = last + 1;
+        }
+        return root;
+    }
+
+private:
+    std::string_view input;
+    Logger* logger;
+    size_t threads;
+    Stats* stats = nullptr;
+    std::vector<Segment> segments;
+
+    struct SegmentResult
+    {
+        TreeRoot root;
+        bool at_boundary = false;
+        CarriedState carried_in;
+        CarriedState carried_out;
+        bool speculative = false;  // parsed with a bottomless return stack
+        size_t required_returns = 0;
+        size_t virtual_pops = 0;
+        std::unique_ptr<Logger> log;  // the messages logged while parsing
+        std::unique_ptr<Stats> stats;  // null if not collecting
+        std::exception_ptr error;
+    };
+    std::vector<SegmentResult> results;
+
+    /**
+     * @brief Returns whether a result is what parsing its segment after the given state would have produced.
+     */
+    static bool fits(const SegmentResult& result, const CarriedState& carried)
+    {
+        if (!result.speculative)
+            return result.carried_in == carried;
+        if (result.carried_in.is_image != carried.is_image || result.carried_in.col_dims != carried.col_dims
+            || result.required_returns > carried.returns.size())
+            return false;
+        return std::all_of(carried.returns.end() - result.required_returns, carried.returns.end(),
+            [](State state) { return state == State::Data; });
+    }
+
+    /**
+     * @brief Returns the return stack a speculative result leaves behind when parsed after the given one.
+     */
+    static std::vector<State> stack_after(const std::vector<State>& before, const SegmentResult& result)
+    {
+        std::vector<State> after(before.begin(), before.end() - result.virtual_pops);
+        after.insert(after.end(), result.carried_out.returns.begin(), result.carried_out.returns.end());
+        return after;
+    }
+
+    /**
+     * @brief Parses the input from the start of `first` to the end of `last` with a fresh parser.
+     * @param speculative If set, the number of State::Data entries on the return stack is not known yet
+     * (see Md_Parser::set_carried_state).
+     */
+    SegmentResult parse_segment(const Segment& first, const Segment& last, const CarriedState& carried, bool speculative = false)
+    {
+        SegmentResult result;
+        result.carried_in = carried;
+        result.speculative = speculative;
+        result.log = Logger::recording(*logger);
+        if (stats != nullptr)
+            result.stats = std::make_unique<Stats>();
+        try {
+            Md_Parser parser(input.substr(first.begin, last.end - first.begin), result.log.get(), first.first_line);
+            parser.set_carried_state(carried, speculative);
+            parser.set_stats(result.stats.get());
+            PhaseTimer timer(result.stats.get(), Parse);
+            result.root = parser.parse_document();
+            result.at_boundary = parser.ended_at_block_boundary();
+            result.carried_out = parser.get_carried_state();
+            result.required_returns = parser.get_return_stack().get_required_depth();
+            result.virtual_pops = parser.get_return_stack().get_virtual_pops();
+        } catch (...) {
+            result.error = std::current_exception();
+        }
+        return result;
+    }
+
+    /**
+     * @brief Moves the top-level children of `subtree` under `root` (or makes it the root if there is none yet).
+     * The arena of `subtree` is kept alive by the arena of `root`.
+     */
+    static void graft(TreeRoot& root, TreeRoot subtree)
+    {
+        if (root == nullptr)
+        {
+            root = std::move(subtree);
+            return;
+        }
+        for (auto&& child : subtree->children)
+        {
+            child->parent = root.get();
+            root->add_child(child);
+        }
+        root.get_deleter().arena->adopt(std::move(subtree.get_deleter().arena));
+        subtree.release();
+    }
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <memory>
 #include "../node.hpp"
+#include "../node_arena.hpp"
 
 /**
  * @class AbstractParser
@@ -12,7 +13,7 @@ class AbstractParser
 {
 public:
     virtual ~AbstractParser() = default;
-    virtual std::unique_ptr<Node> parse_document(bool print_tree = false) = 0;
+    virtual TreeRoot parse_document(bool print_tree = false) = 0;
 };
 
 #endif
\ No newline at end of file
@@ -9,8 +9,17 @@
 #include <memory>
 #include <stack>
 #include <set>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <string_view>
 #include "../token.hpp"
 #include "state.hpp"
+#include "../error_handler.hpp"
+#include "../alloc_accounting.hpp"
+#ifdef STATE_PROFILER
+#include "state_profiler.hpp"
+#endif
 
 /**
  * @brief A set of characters that can be considered escaped in Markdown.
@@ -32,6 +41,153 @@ bool is_escaped_char(char c)
     return it != escaped_chars.end();
 }
 
+/**
+ * @class ConsumedText
+ * @brief The text consumed by state handlers which has not been emitted yet (see Context::consumed).
+ *
+ * Handlers append characters one by one as they read them. As long as the appended characters form
+ * a contiguous run of the input document, only the span (offset and length) of that run is recorded.
+ * Once something that is not the next input byte gets appended (e.g. a re-emitted `**` or a
+ * substituted character), the text is copied into an owned buffer and continues from there. The owned
+ * buffer keeps its capacity between tokens, so it stops reallocating after warming up.
+ */
+class ConsumedText
+{
+public:
+    /**
+     * @brief Attaches the input document the spans are recorded against.
+     * @param input The whole input document.
+     */
+    void bind(std::string_view input)
+    {
+        this->input = input;
+        clear();
+    }
+
+    /**
+     * @brief Sets the offset of the byte the parser is currently processing.
+     * @param pos The offset into the input document.
+     */
+    void set_cursor(size_t pos)
+    {
+        cursor = pos;
+    }
+
+    ConsumedText& operator+=(char c)
+    {
+        ALLOCATION_SITE(ConsumedGrowth);
+        if (owning)
+        {
+            owned += c;
+        }
+        else if (length == 0 && cursor < input.size() && input[cursor] == c)
+        {
+            offset = cursor;
+            length = 1;
+        }
+        else if (length != 0 && offset + length < input.size() && input[offset + length] == c)
+        {
+            ++length;
+        }
+        else
+        {
+            materialize();
+            owned += c;
+        }
+        return *this;
+    }
+
+    ConsumedText& operator+=(std::string_view text)
+    {
+        for (char c : text)
+            *this += c;
+        return *this;
+    }
+
+    ConsumedText& operator=(char c)
+    {
+        clear();
+        return *this += c;
+    }
+
+    ConsumedText& operator=(std::string_view text)
+    {
+        clear();
+        return *this += text;
+    }
+
+    /**
+     * @brief Appends a run of input bytes starting at the cursor in one step.
+     * @param count The number of bytes to append.
+     */
+    void append_run(size_t count)
+    {
+        ALLOCATION_SITE(ConsumedGrowth);
+        if (!owning && length == 0)
+            offset = cursor;
+        if (!owning && offset + length == cursor)
+            length += count;
+        else
+        {
+            materialize();
+            owned.append(input.substr(cursor, count));
+        }
+    }
+
+    bool empty() const
+    {
+        return owning ? owned.empty() : length == 0;
+    }
+
+    void clear()
+    {
+        owned.clear();
+        owning = false;
+        length = 0;
+    }
+
+    /**
+     * @brief Returns the consumed characters without copying them.
+     */
+    std::string_view view() const
+    {
+        return owning ? std::string_view(owned) : input.substr(offset, length);
+    }
+
+    /**
+     * @brief Returns an owned copy of the consumed characters.
+     */
+    std::string str() const
+    {
+        return std::string(view());
+    }
+
+    /**
+     * @brief Returns whether the consumed characters are a span of the input document (see `view`).
+     */
+    bool verbatim() const
+    {
+        return !owning;
+    }
+
+private:
+    std::string_view input;
+    size_t cursor = 0;
+    size_t offset = 0;
+    size_t length = 0;
+    bool owning = false;
+    std::string owned;
+
+    void materialize()
+    {
+        if (owning)
+            return;
+        owned.assign(input.substr(offset, length));
+        owning = true;
+        length = 0;
+    }
+};
+
 /**
  * @class ReturnStateStack
  * @brief A stack for storing states that a Md_Parser instance will return to.
@@ -57,10 +213,17 @@ public:
     {
         if (!is_a_return_state(state))
         {
-            logger->log_error("Pushing a state that is not a return state: " + std::to_string(state));
+            LOG_ERROR(logger, "Pushing a state that is not a return state: " + std::to_string(state));
             throw std::runtime_error(state + " should not be in the stack");
         }
-        return_stack.push(state);
+        {
+            ALLOCATION_SITE(ReturnStack);
+            return_stack.push(state);
+        }
+#ifdef STATE_PROFILER
+        if (profile != nullptr)
+            profile->record_push(return_stack.size());
+#endif
     }
 
     /**
@@ -71,7 +234,12 @@ public:
     {
         if (return_stack.size() == 0)
         {
-            logger->log_warning("Topping an empty stack. Returning State::Data instead.");
+            if (bottomless)
+            {
+                required_depth = std::max(required_depth, virtual_pops + 1);
+                return State::Data;
+            }
+            LOG_WARNING(logger, "Topping an empty stack. Returning State::Data instead.");
             return State::Data;
         }
         return return_stack.top();
@@ -85,16 +253,85 @@ public:
     {
         if (return_stack.size() == 0)
         {
-            logger->log_warning("Popping an empty stack. Returning State::Data instead.");
+            if (bottomless)
+            {
+                required_depth = std::max(required_depth, virtual_pops + 1);
+                ++virtual_pops;
+                return State::Data;
+            }
+            LOG_WARNING(logger, "Popping an empty stack. Returning State::Data instead.");
             return State::Data;
         }
         State top = return_stack.top();
         return_stack.pop();
+#ifdef STATE_PROFILER
+        if (profile != nullptr)
+            profile->record_pop();
+#endif
         return top;
     }
+
+    /**
+     * @brief Returns the states on the stack, from the bottom to the top.
+     */
+    std::vector<State> get_states() const
+    {
+        std::vector<State> states;
+        std::stack<State> copy = return_stack;
+        while (!copy.empty())
+        {
+            states.push_back(copy.top());
+            copy.pop();
+        }
+        std::reverse(states.begin(), states.end());
+        return states;
+    }
+
+    /**
+     * @brief Makes the stack behave as if an unknown number of State::Data entries laid below its bottom
+     * (used when parsing a segment of a document without knowing what precedes it). Reaching below
+     * the bottom is not logged but recorded, see get_required_depth and get_virtual_pops.
+     */
+    void set_bottomless(bool enabled)
+    {
+        bottomless = enabled;
+    }
+
+    /**
+     * @brief Returns how many State::Data entries had to lie below the bottom for every top and pop
+     * to have hit a real entry.
+     */
+    size_t get_required_depth() const
+    {
+        return required_depth;
+    }
+
+    /**
+     * @brief Returns how many entries were popped from below the bottom.
+     */
+    size_t get_virtual_pops() const
+    {
+        return virtual_pops;
+    }
+
+#ifdef STATE_PROFILER
+    /**
+     * @brief Records the pushes and pops from now on in `profile` (see StateProfile).
+     */
+    void set_profile(StateProfile* profile)
+    {
+        this->profile = profile;
+    }
+#endif
 private:
     std::stack<State> return_stack;
+    bool bottomless = false;
+    size_t required_depth = 0;
+    size_t virtual_pops = 0;
     Logger* logger;
+#ifdef STATE_PROFILER
+    StateProfile* profile = nullptr;
+#endif
     std::vector<State> allowed_return_states = {
         State::Data, 
         State::UnorderedListPrep, 
@@ -16,8 +16,8 @@ struct EnumArithmetic
 
 /**
  * @brief The enum for state. If you were to create a new state, add a new value to this enum
- * AND creating a corresponding handler in handlers (state_handlers.hpp) and link them
- * together in *state_handlers* vector.
+ * (before StateCount) AND creating a corresponding handler in handlers (state_handlers.hpp) and link them
+ * together in *state_handlers* array.
  */
 enum State
 {
@@ -51,6 +51,7 @@ enum State
     TableHeaderSeparation, 
     TableCellPipeAwaiting, 
     TableCellData,
+    StateCount,  // not a state, the number of states
 };
 
 #endif
\ No newline at end of file
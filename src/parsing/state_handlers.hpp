@@ -10,7 +10,8 @@
 #include "../error_handler.hpp"
 #include "emitting_middleware.hpp"
 #include "../parsing_tree/tree_builder.hpp"
-#include <functional>
+#include <array>
+#include <utility>
 
 /**
  * @struct Context
@@ -19,7 +20,7 @@
  */
 struct Context {
     bool EOF_Reached;
-    std::string consumed;
+    ConsumedText consumed;
     short counter = 0;
     short alt_counter = 0;
     short indent_level = 0;
@@ -37,9 +38,10 @@ struct Context {
     /**
      * @brief Constructs a Context object.
      * @param logger Pointer to the Logger instance for error handling.
+     * @param arena The arena the parsing tree is allocated in.
      */
-    Context(Logger* logger)
-    : emitter(std::make_unique<Token_Emitter>(std::make_unique<TreeBuilder>(logger), logger)),
+    Context(Logger* logger, std::shared_ptr<NodeArena> arena)
+    : emitter(std::make_unique<Token_Emitter>(std::make_unique<TreeBuilder>(logger, std::move(arena)), logger)),
       return_stack(std::make_unique<ReturnStateStack>(logger)),
       state(State::Data) {}
 
@@ -50,22 +52,20 @@ struct Context {
      */
     void emit_token(const TokenType& type, const ElementType& element)
     {
-        std::string text;
         switch (type)
         {
-        case TokenType::OpenToken:
-            break;
         case TokenType::CloseToken:
             consumed.clear();
             break;
         case TokenType::ContentToken:
-            text = consumed;
+            // the token views the consumed text, which is kept until the token has been consumed
+            emitter->emit_token(Token(type, element, consumed.view(), consumed.verbatim()));
             consumed.clear();
-            break;
+            return;
         default:
             break;
         }
-        emitter->emit_token(Token(type, element, text));
+        emitter->emit_token(Token(type, element));
     }
 
     /**
@@ -95,7 +95,7 @@ struct Context {
         ElementType to_close = return_stack->top() == State::TableCellData
             ? ElementType::Table_Cell
             : Table_Head;
-        consumed = full ? to_emit : to_emit + consumed;
+        consumed = full ? to_emit : to_emit + consumed.str();
         emit_token(TokenType::ContentToken, ElementType::Content);
         state = return_stack->top_n_pop();
         emit_token(TokenType::CloseToken, to_close);
@@ -159,7 +159,7 @@ struct Context {
      */
     bool consumed_only_whitespace()
     {
-        for (auto&& c : consumed)
+        for (auto&& c : consumed.view())
         {
             if (c != ' ' && c != '\t')
                 return false;
@@ -168,12 +168,21 @@ struct Context {
     }
 };
 
+/**
+ * @brief Emits the opening token of an image or a hyperlink viewing the collected url, alt text and title.
+ */
+void emit_link_token(Context& context, ElementType element)
+{
+    LinkText link{context.alt, context.consumed.view()};
+    context.emitter->emit_token(Token(TokenType::OpenToken, element, context.src, false, &link));
+}
+
 /**
  * @brief Emits an image token.
  */
 void emit_image(Context& context)
 {
-    context.emitter->emit_token(Token(TokenType::OpenToken, ElementType::ImageType, context.src, context.alt, context.consumed));
+    emit_link_token(context, ElementType::ImageType);
     context.emit_token(TokenType::CloseToken, ElementType::ImageType);
     context.src.clear();
     context.alt.clear();
@@ -185,7 +194,7 @@ void emit_image(Context& context)
  */
 void emit_hyperlink(Context& context)
 {
-    context.emitter->emit_token(Token(TokenType::OpenToken, ElementType::Hypertext, context.src, context.alt, context.consumed));
+    emit_link_token(context, ElementType::Hypertext);
     context.emit_token(TokenType::CloseToken, ElementType::Hypertext);
     context.src.clear();
     context.alt.clear();
@@ -328,7 +337,7 @@ namespace handlers
         }
         else if (next == '\n') {
             for (short i = 0; i < context.counter; ++i) { context.consumed += '#'; }
-            context.handle_unexpected_newline(std::move(context.consumed), context.EOF_Reached);
+            context.handle_unexpected_newline(context.consumed.str(), context.EOF_Reached);
         }
         else { 
             for (short i = 0; i < context.counter; ++i) { context.consumed += '#'; }
@@ -378,7 +387,7 @@ namespace handlers
             break;
         case '\n':
             context.warning_msg = "Unclosed asterisk signifying bold text - converting to plain text";
-            context.handle_unexpected_newline('*' + context.consumed, context.EOF_Reached);
+            context.handle_unexpected_newline('*' + context.consumed.str(), context.EOF_Reached);
             break;
         case '|':
             if (context.return_stack->top() == TableCellData || context.return_stack->top() == TableHeaderNames) {
@@ -439,9 +448,9 @@ namespace handlers
                 break;
             case '\n':
                 context.warning_msg = "Unclosed asterisk signifying bold text - converting to plain text";
-                context.consumed = "**" + context.consumed;
+                context.consumed = "**" + context.consumed.str();
                 if (context.counter == 1) context.consumed += '*';
-                context.handle_unexpected_newline(std::move(context.consumed), context.EOF_Reached);
+                context.handle_unexpected_newline(context.consumed.str(), context.EOF_Reached);
                 break;
             case '|':
                 if (context.return_stack->top() == TableCellData || context.return_stack->top() == TableHeaderNames) {
@@ -506,9 +515,9 @@ namespace handlers
                 break;
             case '\n':
                 context.warning_msg = "Unclosed asterisk signifying bold text - converting to plain text";
-                context.consumed = "***" + context.consumed;
+                context.consumed = "***" + context.consumed.str();
                 for (short i = 0; i < context.counter; ++i) {context.consumed += '*';}
-                context.handle_unexpected_newline(std::move(context.consumed), context.EOF_Reached);
+                context.handle_unexpected_newline(context.consumed.str(), context.EOF_Reached);
                 break;
             case '|':
                 if (context.return_stack->top() == TableCellData || context.return_stack->top() == TableHeaderNames) {
@@ -535,7 +544,7 @@ namespace handlers
             context.state = State::DataOrdinalNumber;
             break;
         case '\n':
-            context.handle_unexpected_newline(std::move(context.consumed), context.EOF_Reached);
+            context.handle_unexpected_newline(context.consumed.str(), context.EOF_Reached);
             break;
         default:
             context.consumed += next;
@@ -599,7 +608,7 @@ namespace handlers
             
             break;
         case '\n':
-            context.handle_unexpected_newline(std::move(context.consumed), context.EOF_Reached);
+            context.handle_unexpected_newline(context.consumed.str(), context.EOF_Reached);
             break;
         default:
             context.consumed += next;
@@ -722,7 +731,7 @@ namespace handlers
             break;
         case '\n':
             context.warning_msg = "Unclosed backtick signifying a code element - handling as plain text";
-            context.handle_unexpected_newline('`' + context.consumed, context.EOF_Reached);
+            context.handle_unexpected_newline('`' + context.consumed.str(), context.EOF_Reached);
             break;
         case '|':
             if (context.return_stack->top() == TableHeaderNames || context.return_stack->top() == TableCellData)
@@ -959,8 +968,8 @@ namespace handlers
         case '\n':
             context.consumed = "[" + context.alt;
             if (context.is_image)
-                context.consumed = '!' + context.consumed;
-            context.handle_unexpected_newline(std::move(context.consumed), context.EOF_Reached);
+                context.consumed = '!' + context.consumed.str();
+            context.handle_unexpected_newline(context.consumed.str(), context.EOF_Reached);
             context.alt.clear();
             break;
         case '|':
@@ -984,10 +993,10 @@ namespace handlers
             context.state = UrlOpenRound;
             break;
         case '\n':
-            context.consumed = "[" + context.alt + "]" + context.consumed;
+            context.consumed = "[" + context.alt + "]" + context.consumed.str();
             if (context.is_image)
-                context.consumed = '!' + context.consumed;
-            context.handle_unexpected_newline(std::move(context.consumed), context.EOF_Reached);
+                context.consumed = '!' + context.consumed.str();
+            context.handle_unexpected_newline(context.consumed.str(), context.EOF_Reached);
             context.alt.clear();
             break;
         case '|':
@@ -998,7 +1007,7 @@ namespace handlers
         default:
             context.consumed = "[" + context.alt + "]" + next;
             if (context.is_image)
-                context.consumed = '!' + context.consumed;
+                context.consumed = '!' + context.consumed.str();
             context.state = context.return_stack->top_n_pop();
             context.alt.clear();
             break;
@@ -1024,10 +1033,10 @@ namespace handlers
             context.state = TitleOpenRound;
             break;
         case '\n':
-            context.consumed = "[" + context.alt + "](" + context.consumed;
+            context.consumed = "[" + context.alt + "](" + context.consumed.str();
             if (context.is_image)
-                context.consumed = '!' + context.consumed;
-            context.handle_unexpected_newline(std::move(context.consumed), context.EOF_Reached);
+                context.consumed = '!' + context.consumed.str();
+            context.handle_unexpected_newline(context.consumed.str(), context.EOF_Reached);
             context.alt.clear();
             context.src.clear();
             break;
@@ -1055,8 +1064,8 @@ namespace handlers
         case '\n':
             context.consumed = "[" + context.alt + "](" + context.src + ' ';
             if (context.is_image)
-                context.consumed = '!' + context.consumed;
-            context.handle_unexpected_newline(std::move(context.consumed), context.EOF_Reached);
+                context.consumed = '!' + context.consumed.str();
+            context.handle_unexpected_newline(context.consumed.str(), context.EOF_Reached);
             context.alt.clear();
             context.src.clear();
             break;
@@ -1068,7 +1077,7 @@ namespace handlers
         default:
             context.consumed = "[" + context.alt + "](" + context.src + ' ' + next;
             if (context.is_image)
-                context.consumed = '!' + context.consumed;
+                context.consumed = '!' + context.consumed.str();
             context.alt.clear();
             context.src.clear();
             context.state = context.return_stack->top_n_pop();
@@ -1087,10 +1096,10 @@ namespace handlers
                 context.state = TitleClosedRound;
                 break;
             case '\n':
-                context.consumed = "![" + context.alt + "](" + context.src + " \"" + context.consumed;
+                context.consumed = "![" + context.alt + "](" + context.src + " \"" + context.consumed.str();
                 if (context.is_image)
-                    context.consumed = '!' + context.consumed;
-                context.handle_unexpected_newline(std::move(context.consumed), context.EOF_Reached);
+                    context.consumed = '!' + context.consumed.str();
+                context.handle_unexpected_newline(context.consumed.str(), context.EOF_Reached);
                 context.alt.clear();
                 context.src.clear();
                 break;
@@ -1121,20 +1130,20 @@ namespace handlers
             context.state = context.return_stack->top_n_pop();
             break;
         case '\n':
-            context.consumed = "[" + context.alt + "](" + context.src + " \"" + context.consumed + '"';
+            context.consumed = "[" + context.alt + "](" + context.src + " \"" + context.consumed.str() + '"';
             if (context.is_image)
-                context.consumed = '!' + context.consumed;
-            context.handle_unexpected_newline(std::move(context.consumed), context.EOF_Reached);
+                context.consumed = '!' + context.consumed.str();
+            context.handle_unexpected_newline(context.consumed.str(), context.EOF_Reached);
             context.alt.clear();
             context.src.clear();
             break;
         case '|':
             if (!context.is_image && (context.return_stack->top() == TableHeaderNames || context.return_stack->top() == TableCellData)) {
-                context.handle_pipe_in_table("[" + context.alt + "](" + context.src + " \"" + context.consumed + '"');
+                context.handle_pipe_in_table("[" + context.alt + "](" + context.src + " \"" + context.consumed.str() + '"');
                 break;
             }
         default:
-            context.consumed = "![" + context.alt + "](" + context.src + " \"" + context.consumed + next;
+            context.consumed = "![" + context.alt + "](" + context.src + " \"" + context.consumed.str() + next;
             context.alt.clear();
             context.src.clear();
             context.state = context.return_stack->top_n_pop();
@@ -1352,11 +1361,16 @@ namespace handlers
 }
 
 /**
- * @brief The linkage connecting states to their handlers. For better efficiency, it is implemented
- * with a vector, not a map. This works IFF we follow the same order of states as in the State enum,
- * since the value of State is used as an index during lookup.
+ * @brief A plain function pointer to a state handler (see namespace handlers).
+ */
+using StateHandler = void (*)(Context&, char);
+
+/**
+ * @brief The linkage connecting states to their handlers. It is built at compile time and indexed
+ * by the value of State, so the order has to follow the State enum. This is checked by the
+ * static_assert below rather than on every lookup.
  */
-std::vector<std::pair<State, std::function<void(Context&, char)>>> state_handlers = {
+constexpr std::array<std::pair<State, StateHandler>, State::StateCount> state_handlers = {{
     {State::Data, handlers::handleData},
     {State::DataHashtag, handlers::handleHashtag},
     {State::DataAsterisk, handlers::handleDataAsterisk},
@@ -1387,6 +1401,21 @@ std::vector<std::pair<State, std::function<void(Context&, char)>>> state_handler
     {State::TableHeaderSeparation, handlers::handleTableHeaderSeparation},
     {State::TableCellPipeAwaiting, handlers::handleTableCellPipeAwaiting},
     {State::TableCellData, handlers::handleTableCellData}
-};
+}};
+
+/**
+ * @brief Checks that every state sits at the index equal to its value and has a handler.
+ */
+constexpr bool state_handlers_ordered()
+{
+    for (size_t i = 0; i < state_handlers.size(); ++i)
+    {
+        if (state_handlers[i].first != static_cast<State>(i) || state_handlers[i].second == nullptr)
+            return false;
+    }
+    return true;
+}
+
+static_assert(state_handlers_ordered(), "state_handlers has to follow the order of the State enum");
 
 #endif
\ No newline at end of file
@@ -0,0 +1,196 @@
+/**
+ * @file state_profiler.hpp
+ * @brief Profiling the parser's state machine, compiled in only with STATE_PROFILER defined.
+ */
+
+#ifndef _STATE_PROFILER_HPP
+#define _STATE_PROFILER_HPP
+
+#include <array>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <ostream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include "state.hpp"
+
+/**
+ * @brief The names of the states, in the order of the State enum.
+ */
+constexpr std::array<const char*, State::StateCount> state_names = {
+    "Data", "DataHashtag", "DataAsterisk", "DataAsteriskData", "DataDoubleAsterisk", "DataDoubleAsteriskData",
+    "DataTripleAsterisk", "DataTripleAsteriskData", "DataConsumingNumber", "DataOrdinalNumber", "HorizontalLine",
+    "DataBacktick", "DataDoubleBacktick", "CodeInline", "CodeBlock", "UnorderedListPrep", "UnorderedList",
+    "OrderedListPrep", "Image", "AltOpenSquared", "AltClosedSquared", "UrlOpenRound", "TitleOpenRound",
+    "TitleConsuming", "TitleClosedRound", "TableHeaderNames", "TableHeaderSeparationPipeAwaiting",
+    "TableHeaderSeparation", "TableCellPipeAwaiting", "TableCellData"
+};
+
+/**
+ * @class StateProfile
+ * @brief Counts what the state machine of a Md_Parser does: the bytes processed and the time spent in every State,
+ * the transitions between states and how deep the ReturnStateStack grows.
+ *
+ * Every parser keeps its own profile and adds it to the process-wide one (see `global`) once it has finished,
+ * which `write_global` then writes as a report. All of this exists only in builds with STATE_PROFILER defined
+ * (cmake -DSTATE_PROFILER=ON), other builds are not slowed down at all.
+ */
+class StateProfile
+{
+public:
+    static constexpr size_t DEPTH_BUCKETS = 16;  // the last bucket holds all deeper pushes
+
+    std::array<size_t, State::StateCount> bytes = {};  // including the plain text skipped in State::Data
+    std::array<size_t, State::StateCount> calls = {};  // handler calls
+    std::array<double, State::StateCount> seconds = {};  // time spent in the handlers
+    std::array<std::array<size_t, State::StateCount>, State::StateCount> transitions = {};  // [from][to]
+    std::array<size_t, DEPTH_BUCKETS> push_depths = {};  // the depth of the stack after each push
+    size_t pushes = 0;
+    size_t pops = 0;
+    size_t max_depth = 0;
+
+    /**
+     * @brief Records a handler call.
+     * @param from The state the handler belongs to.
+     * @param to The state the handler left the parser in.
+     * @param elapsed The time the call took.
+     */
+    void record_call(State from, State to, std::chrono::steady_clock::duration elapsed)
+    {
+        ++bytes[from];
+        ++calls[from];
+        seconds[from] += std::chrono::duration<double>(elapsed).count();
+        ++transitions[from][to];
+    }
+
+    void record_push(size_t depth)
+    {
+        ++pushes;
+        ++push_depths[std::min(depth, DEPTH_BUCKETS - 1)];
+        max_depth = std::max(max_depth, depth);
+    }
+
+    void record_pop()
+    {
+        ++pops;
+    }
+
+    void merge(const StateProfile& other)
+    {
+        for (size_t i = 0; i < State::StateCount; ++i)
+        {
+            bytes[i] += other.bytes[i];
+            calls[i] += other.calls[i];
+            seconds[i] += other.seconds[i];
+            for (size_t j = 0; j < State::StateCount; ++j)
+                transitions[i][j] += other.transitions[i][j];
+        }
+        for (size_t i = 0; i < DEPTH_BUCKETS; ++i)
+            push_depths[i] += other.push_depths[i];
+        pushes += other.pushes;
+        pops += other.pops;
+        max_depth = std::max(max_depth, other.max_depth);
+    }
+
+    /**
+     * @brief Writes the report: the states by time spent, the transitions by count and the stack depths.
+     */
+    void write_report(std::ostream& out) const
+    {
+        size_t total_bytes = 0;
+        double total_seconds = 0;
+        for (size_t i = 0; i < State::StateCount; ++i)
+        {
+            total_bytes += bytes[i];
+            total_seconds += seconds[i];
+        }
+
+        std::vector<size_t> order(State::StateCount);
+        for (size_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) { return seconds[a] > seconds[b]; });
+
+        out << "State profile: " << total_bytes << " bytes, " << total_seconds * 1000 << " ms in handlers\n\n";
+        out << std::left << std::setw(36) << "state" << std::right << std::setw(12) << "bytes" << std::setw(9) << "bytes %"
+            << std::setw(12) << "calls" << std::setw(12) << "ms" << std::setw(9) << "time %" << std::setw(10) << "ns/call\n";
+        for (size_t i : order)
+        {
+            if (bytes[i] == 0)
+                continue;
+            out << std::left << std::setw(36) << state_names[i] << std::right << std::setw(12) << bytes[i]
+                << std::setw(9) << std::fixed << std::setprecision(1) << percent(bytes[i], total_bytes)
+                << std::setw(12) << calls[i]
+                << std::setw(12) << std::setprecision(3) << seconds[i] * 1000
+                << std::setw(9) << std::setprecision(1) << percent(seconds[i], total_seconds)
+                << std::setw(9) << std::setprecision(1) << (calls[i] == 0 ? 0 : seconds[i] * 1e9 / calls[i]) << '\n';
+        }
+        out << std::defaultfloat;
+
+        std::vector<std::pair<size_t, size_t>> edges;
+        for (size_t i = 0; i < State::StateCount; ++i)
+            for (size_t j = 0; j < State::StateCount; ++j)
+                if (transitions[i][j] != 0)
+                    edges.emplace_back(i, j);
+        std::stable_sort(edges.begin(), edges.end(), [this](auto a, auto b) {
+            return transitions[a.first][a.second] > transitions[b.first][b.second];
+        });
+        out << "\nTransitions (nonzero entries of the from x to matrix, staying in a state included)\n";
+        for (auto&& [from, to] : edges)
+            out << std::left << std::setw(36) << state_names[from] << " -> " << std::setw(36) << state_names[to]
+                << std::right << std::setw(12) << transitions[from][to] << '\n';
+
+        out << "\nReturn stack: " << pushes << " pushes, " << pops << " pops, max depth " << max_depth << '\n';
+        for (size_t i = 1; i < DEPTH_BUCKETS; ++i)
+        {
+            if (push_depths[i] != 0)
+                out << "  depth " << i << (i == DEPTH_BUCKETS - 1 ? "+" : "") << ": " << push_depths[i] << '\n';
+        }
+    }
+
+    /**
+     * @brief Returns the profile of all parsers of the process which have finished.
+     */
+    static StateProfile& global()
+    {
+        static StateProfile profile;
+        return profile;
+    }
+
+    /**
+     * @brief Adds a parser's profile to the global one. Can be called from any thread.
+     */
+    static void add_to_global(const StateProfile& profile)
+    {
+        std::lock_guard<std::mutex> lock(global_mutex());
+        global().merge(profile);
+    }
+
+    /**
+     * @brief Writes the report of the global profile to a file.
+     * @return Whether the file could be written.
+     */
+    static bool write_global(const std::string& path)
+    {
+        std::ofstream out(path);
+        std::lock_guard<std::mutex> lock(global_mutex());
+        global().write_report(out);
+        return !out.fail();
+    }
+
+private:
+    static double percent(double part, double whole)
+    {
+        return whole == 0 ? 0 : part * 100 / whole;
+    }
+
+    static std::mutex& global_mutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+};
+
+#endif
@@ -0,0 +1,155 @@
+/**
+ * @file streamed_input.hpp
+ * @brief A document read by a thread of its own while it is already being parsed.
+ */
+
+#ifndef _STREAMED_INPUT_HPP
+#define _STREAMED_INPUT_HPP
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include "input_source.hpp"
+#include "../wait_point.hpp"
+
+/**
+ * @brief The number of bytes the reader thread of a StreamedInput reads at once, i.e. how far it is
+ *        ahead of the parser at the least.
+ */
+#ifndef STREAMED_INPUT_CHUNK_SIZE
+#define STREAMED_INPUT_CHUNK_SIZE (1 << 18)
+#endif
+
+/**
+ * @class StreamedInput
+ * @brief Holds the whole input document as one contiguous block of bytes, like InputSource, but fills it
+ * on a reader thread while the parser already walks the part read so far.
+ *
+ * The buffer is allocated with the size of the file up front, so `view()` is stable from the start
+ * and the parser's views into it stay valid. The bytes up to `available()` have been read. Anything which
+ * has no size known in advance (pipes, character devices, empty files, non-POSIX systems) is read
+ * through an InputSource by `open` instead, and is then available whole right away.
+ *
+ * @see Md_Parser
+ */
+class StreamedInput
+{
+public:
+    StreamedInput() = default;
+    StreamedInput(const StreamedInput&) = delete;
+    StreamedInput& operator=(const StreamedInput&) = delete;
+
+    ~StreamedInput()
+    {
+        if (reader.joinable())
+            reader.join();
+#ifdef INPUT_SOURCE_POSIX
+        if (fd >= 0)
+            ::close(fd);
+#endif
+    }
+
+    /**
+     * @brief Opens the document at the given path and starts reading it.
+     * @return true if the document could be opened (and, if not read on a thread, read), false otherwise.
+     */
+    bool open(const std::string& path)
+    {
+#ifdef INPUT_SOURCE_POSIX
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+        {
+            size = info.st_size;
+            buffer.reset(new char[size]);
+            reader = std::thread([this] { read_chunks(); });
+            return true;
+        }
+        ::close(fd);
+        fd = -1;
+#endif
+        if (!whole.open(path))
+            return false;
+        size = whole.view().size();
+        filled.store(size, std::memory_order_relaxed);
+        finished.store(true, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Returns the whole document, of which only the first `available()` bytes may be read yet.
+     */
+    std::string_view view() const
+    {
+        return buffer != nullptr ? std::string_view(buffer.get(), size) : whole.view();
+    }
+
+    /**
+     * @brief Returns the number of bytes which have been read.
+     */
+    size_t available() const
+    {
+        return filled.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Waits until more than `pos` bytes have been read or reading has ended.
+     * @return The number of bytes read, at most `pos` only if reading ended (see `failed`).
+     */
+    size_t wait_beyond(size_t pos) const
+    {
+        read_more.wait([this, pos] {
+            return filled.load(std::memory_order_acquire) > pos || finished.load(std::memory_order_acquire);
+        });
+        return filled.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Returns whether reading stopped before the end of the document. Valid once `wait_beyond`
+     * returned without reaching the end.
+     */
+    bool failed() const
+    {
+        return finished.load(std::memory_order_acquire) && filled.load(std::memory_order_acquire) < size;
+    }
+
+private:
+    InputSource whole;  // the document when it is not read on a thread
+    std::unique_ptr<char[]> buffer;
+    size_t size = 0;
+    std::atomic<size_t> filled = 0;
+    std::atomic<bool> finished = false;
+    mutable WaitPoint read_more;  // the parser waits for the reader
+    std::thread reader;
+    int fd = -1;
+
+#ifdef INPUT_SOURCE_POSIX
+    /**
+     * @brief The loop of the reader thread.
+     */
+    void read_chunks()
+    {
+        size_t read_so_far = 0;
+        while (read_so_far < size)
+        {
+            ssize_t count = ::read(fd, buffer.get() + read_so_far, std::min<size_t>(STREAMED_INPUT_CHUNK_SIZE, size - read_so_far));
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                break;  // an error, or the file has been truncated since
+            read_so_far += count;
+            filled.store(read_so_far, std::memory_order_release);
+            read_more.notify();
+        }
+        finished.store(true, std::memory_order_release);
+        read_more.notify();
+    }
+#endif
+};
+
+#endif
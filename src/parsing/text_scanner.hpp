@@ -0,0 +1,123 @@
+/**
+ * @file text_scanner.hpp
+ * @brief Vectorized search for the next byte that matters to State::Data.
+ */
+
+#ifndef _TEXT_SCANNER_HPP
+#define _TEXT_SCANNER_HPP
+
+#include <array>
+#include <cstddef>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define TEXT_SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * @namespace text_scanner
+ * @brief Finds the end of a run of plain text, i.e. the first byte handlers::handleData does not just append.
+ *
+ * The bytes are `# * - ` > [ ! | \n \`. Digits only matter at the start of a line, when nothing has
+ * been consumed yet, and the parser only skips ahead once something has been consumed, so they are not
+ * part of the set. Three implementations exist: a table-driven scalar one, an SSE2 one (always present
+ * on x86-64) and an AVX2 one which is picked at runtime if the CPU supports it.
+ */
+namespace text_scanner
+{
+    constexpr char SPECIAL_CHARS[] = {'#', '*', '-', '`', '>', '[', '!', '|', '\n', '\\'};
+
+    constexpr std::array<bool, 256> make_special_table()
+    {
+        std::array<bool, 256> table{};
+        for (char c : SPECIAL_CHARS)
+            table[static_cast<unsigned char>(c)] = true;
+        return table;
+    }
+
+    constexpr std::array<bool, 256> special_table = make_special_table();
+
+    /**
+     * @brief Signature shared by all implementations.
+     * @return The offset of the first special byte in [data, data + size), or size if there is none.
+     */
+    using ScanFunction = size_t (*)(const char* data, size_t size);
+
+    static size_t find_special_scalar(const char* data, size_t size)
+    {
+        size_t i = 0;
+        while (i < size && !special_table[static_cast<unsigned char>(data[i])])
+            ++i;
+        return i;
+    }
+
+#ifdef TEXT_SCANNER_X86
+    static size_t find_special_sse2(const char* data, size_t size)
+    {
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16)
+        {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i hits = _mm_setzero_si128();
+            for (char c : SPECIAL_CHARS)
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(c)));
+            int mask = _mm_movemask_epi8(hits);
+            if (mask != 0)
+                return i + __builtin_ctz(mask);
+        }
+        return i + find_special_scalar(data + i, size - i);
+    }
+
+    /**
+     * With AVX2 a byte is classified by two nibble lookups instead of one comparison per special byte:
+     * it is special iff low_nibble_bits[low] & high_nibble_bits[high] != 0. Each bit stands for one
+     * high nibble (0x0_, 0x2_, 0x3_, 0x5_, 0x6_, 0x7_) and is set for the low nibbles of that row.
+     */
+    __attribute__((target("avx2")))
+    static size_t find_special_avx2(const char* data, size_t size)
+    {
+        const __m256i low_nibble_bits = _mm256_setr_epi8(
+            0x10, 0x02, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x08, 0x28, 0x02, 0x04, 0x00,
+            0x10, 0x02, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x08, 0x28, 0x02, 0x04, 0x00);
+        const __m256i high_nibble_bits = _mm256_setr_epi8(
+            0x01, 0x00, 0x02, 0x04, 0x00, 0x08, 0x10, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x01, 0x00, 0x02, 0x04, 0x00, 0x08, 0x10, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00);
+        const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32)
+        {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            __m256i low = _mm256_shuffle_epi8(low_nibble_bits, _mm256_and_si256(chunk, nibble_mask));
+            __m256i high = _mm256_shuffle_epi8(high_nibble_bits, _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble_mask));
+            __m256i misses = _mm256_cmpeq_epi8(_mm256_and_si256(low, high), _mm256_setzero_si256());
+            unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(misses));
+            if (mask != 0)
+                return i + __builtin_ctz(mask);
+        }
+        return i + find_special_sse2(data + i, size - i);
+    }
+#endif
+
+    /**
+     * @brief Picks the widest implementation the CPU supports.
+     */
+    static ScanFunction select_implementation()
+    {
+#ifdef TEXT_SCANNER_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return find_special_avx2;
+        return find_special_sse2;
+#else
+        return find_special_scalar;
+#endif
+    }
+
+    /**
+     * @brief The implementation chosen for this machine, resolved once at startup.
+     */
+    static const ScanFunction find_special = select_implementation();
+}
+
+#endif
@@ -0,0 +1,89 @@
+/**
+ * @file token_sink.hpp
+ * @brief The interface receiving the tokens of a parsed document as events.
+ */
+
+#ifndef _TOKEN_SINK_HPP
+#define _TOKEN_SINK_HPP
+
+#include "../token.hpp"
+#include "../node.hpp"
+
+/**
+ * @class TokenSink
+ * @brief Receives the tokens emitted by Token_Emitter, in document order: an open token, the attributes
+ * of the opened element, its content and nested elements, then a close token.
+ *
+ * TreeBuilder is the sink building a parsing tree. Other sinks (see Md_Parser::set_sink) process the
+ * document as a stream of events, with memory bounded by the nesting depth, except for tables: a table
+ * is only known to be one once it has ended, so it is built as a subtree first and then handed over
+ * whole (see `append_subtree`).
+ *
+ * The payloads of a token are views which are only valid during the call, unless the token is verbatim
+ * (see Token). For a custom sink, elements still open at the end of the document are closed before
+ * `end_document`.
+ */
+class TokenSink
+{
+public:
+    virtual ~TokenSink() = default;
+
+    /**
+     * @brief Receives an open, close or content token.
+     */
+    virtual void consume_token(Token token) = 0;
+
+    /**
+     * @brief Receives an attribute of the innermost open element.
+     */
+    virtual void add_attribute(Attribute attribute) = 0;
+
+    /**
+     * @brief Receives a finished subtree (a table, or the last row of a failed table as a paragraph) to append
+     * to the innermost open element. By default it is replayed as tokens. The nodes are only valid during the call.
+     */
+    virtual void append_subtree(Node* subtree_root)
+    {
+        replay(*subtree_root);
+    }
+
+    /**
+     * @brief Called once the whole document has been emitted.
+     */
+    virtual void end_document() {}
+
+protected:
+    /**
+     * @brief Sends a subtree to this sink as the tokens it would have been built from.
+     */
+    void replay(const Node& node)
+    {
+        if (auto content = dynamic_cast<const ContentNode*>(&node))
+        {
+            consume_token(Token(TokenType::ContentToken, node.element, content->content.view(), content->content.is_view()));
+            return;
+        }
+        LinkText link;
+        Token open(TokenType::OpenToken, node.element);
+        if (auto image = dynamic_cast<const ImageNode*>(&node))
+        {
+            link = LinkText{image->alt, image->title};
+            open.text = image->src;
+            open.link = &link;
+        }
+        else if (auto hyperlink = dynamic_cast<const HyperlinkNode*>(&node))
+        {
+            link = LinkText{hyperlink->displayed, hyperlink->title};
+            open.text = hyperlink->href;
+            open.link = &link;
+        }
+        consume_token(open);
+        for (Attribute attribute : node.attributes)
+            add_attribute(attribute);
+        for (const Node* child : node.children)
+            replay(*child);
+        consume_token(Token(TokenType::CloseToken, node.element));
+    }
+};
+
+#endif
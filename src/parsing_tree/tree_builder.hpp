@@ -4,96 +4,130 @@
 #include "../token.hpp"
 #include <memory>
 #include "../node.hpp"
+#include "../node_arena.hpp"
+#include "../flat_tree.hpp"
+#include "token_sink.hpp"
 #include <iostream>
 #include <stack>
+#include <functional>
 #include "../error_handler.hpp"
 
 /**
  * @class TreeBuilder
  * @brief A class reponsible for creating and building a tree from tokens emitted by TokenEmitter.
- * It stores the root of the tree as a unique_ptr and traverses the tree
- * with a raw pointer.
+ * All nodes are allocated in a NodeArena, the tree is traversed with a raw pointer.
+ * Alternatively, the tree can be built directly into a FlatTree (see `build_flat`), or handed over block by block
+ * (see `set_block_handler`).
  */
-class TreeBuilder {
+class TreeBuilder final : public TokenSink {
 public:
+    /**
+     * @brief A function receiving a finished top-level block of the document.
+     */
+    using BlockHandler = std::function<void(Node&)>;
+
     /**
      * @brief Constructs a TreeBuilder object.
      * @param logger Pointer to the Logger instance for error handling.
+     * @param arena The arena owning the built tree. It must not hold another tree.
      */
-    TreeBuilder (Logger* logger) : root(std::make_unique<Node>(ElementType::DOCSTART, nullptr)), logger(logger) {
-        current = root.get();
+    TreeBuilder (Logger* logger, std::shared_ptr<NodeArena> arena)
+    : arena(std::move(arena)),
+      logger(logger) {
+        root = this->arena->create<Node>(ElementType::DOCSTART, nullptr);
+        current = root;
     }
 
     /**
      * @brief Consumes a token and builds the tree accordingly.
      * @param token The token to consume.
      */
-    void consume_token (Token&& token) {
+    void consume_token (Token token) override {
+        if (token.type != TokenType::EOF_Token && current_missing())
+        {
+            LOG_ERROR(logger, "Current is null. The error is on our side, we're working on it.");
+            throw std::runtime_error("Error during tree parsing");
+        }
+        if (flat != nullptr)
+        {
+            consume_flat_token(token);
+            return;
+        }
         switch (token.type)
         {
         case TokenType::OpenToken: 
             if (token.element == ElementType::ImageType)
             {
-                auto new_node = std::make_unique<ImageNode>(
-                    current, std::move(token.content), std::move(token.alt), std::move(token.title)
+                ALLOCATION_SITE(TokenConstruction);
+                auto new_node = arena->create<ImageNode>(
+                    current, std::string(token.text), std::string(token.link->alt), std::string(token.link->title)
                 );
-                current = new_node.get();
-                current->parent->add_child(std::move(new_node));
+                current = new_node;
+                current->parent->add_child(new_node);
                 break;
             }
             else if (token.element == ElementType::Hypertext)
             {
-                auto new_node = std::make_unique<HyperlinkNode>(
-                    current, std::move(token.content), std::move(token.alt), std::move(token.title)
+                ALLOCATION_SITE(TokenConstruction);
+                auto new_node = arena->create<HyperlinkNode>(
+                    current, std::string(token.text), std::string(token.link->alt), std::string(token.link->title)
                 );
-                current = new_node.get();
-                current->parent->add_child(std::move(new_node));
+                current = new_node;
+                current->parent->add_child(new_node);
                 break;
             }
             else
             {
-                auto new_node = std::make_unique<Node>(token.element, current);
-                current = new_node.get();
-                current->parent->add_child(std::move(new_node));
+                auto new_node = arena->create<Node>(token.element, current);
+                current = new_node;
+                current->parent->add_child(new_node);
                 break;
             }
         case TokenType::CloseToken:
             if (token.element != current->element) {
-                logger->log_error("Current element ("+element_to_html_name[current->element]+") and \
+                LOG_ERROR(logger, "Current element ("+element_to_html_name[current->element]+") and \
                     closing tag element ("+element_to_html_name[token.element]+") do not match. This is an error on our side.");
                 throw std::runtime_error("incorrectly parsed tree");
             }
             if (current->element == ElementType::DOCSTART)
-                logger->log_warning("Moving 'current' above DOCTYPE element making it a nullptr.");
+                LOG_WARNING(logger, "Moving 'current' above DOCTYPE element making it a nullptr.");
             current = current->parent;
             break;
         case TokenType::ContentToken:
             {
-                auto new_node = std::make_unique<ContentNode>(token.element, current, std::move(token.content));
-                current->add_child(std::move(new_node));
+                auto new_node = arena->create<ContentNode>(token.element, current, token.to_text());
+                current->add_child(new_node);
                 break;
             }
         case TokenType::EOF_Token:
             break;
         default:
-            logger->log_error("Unknown tokentype found during tree parsing.");
+            LOG_ERROR(logger, "Unknown tokentype found during tree parsing.");
             throw std::runtime_error("huh");
         }
+        hand_over_blocks();
     }
 
     /**
     * Notes: - the position of current stays the same
     *        - intended for appending a tree created by Managers (e.g. @class TableManager)
+    *        - the subtree is kept, so it has to be allocated in the arena of the builder
     */
-    void append_subtree(std::unique_ptr<Node> subtree_root)
+    void append_subtree(Node* subtree_root) override
     {
-        if (current==nullptr)
+        if (current_missing())
         {
-            logger->log_error("Current is null. The error is on our side, we're working on it.");
+            LOG_ERROR(logger, "Current is null. The error is on our side, we're working on it.");
             throw std::runtime_error("Error during tree parsing");
         }
-        logger->log_info("Appending subtree with root element: " + element_to_html_name[subtree_root->element]);
-        current->add_child(std::move(subtree_root));
+        LOG_INFO(logger, "Appending subtree with root element: " + element_to_html_name[subtree_root->element]);
+        if (flat != nullptr)
+            flat->append_subtree(flat_current, subtree_root);
+        else
+        {
+            current->add_child(subtree_root);
+            hand_over_blocks();
+        }
     }
 
     /**
@@ -102,44 +136,105 @@ public:
      */
     ElementType get_current_element()
     {
-        if (current==nullptr)
+        if (current_missing())
         {
-            logger->log_error("Current is null. The error is on our side, we're working on it.");
+            LOG_ERROR(logger, "Current is null. The error is on our side, we're working on it.");
             throw std::runtime_error("Error during tree parsing");
         }
-        return current->element;
+        return flat != nullptr ? flat->elements[flat_current] : current->element;
     }
 
     /**
      * @brief Adds an attribute to the current node.
      * @param att The attribute to add.
      */
-    void add_attribute(Attribute&& att)
+    void add_attribute(Attribute att) override
     {
-        if (current==nullptr)
+        if (current_missing())
         {
-            logger->log_error("Current is null. The error is on our side, we're working on it.");
+            LOG_ERROR(logger, "Current is null. The error is on our side, we're working on it.");
             throw std::runtime_error("Error during tree parsing");
         }
-        current->add_attribute(std::move(att));
+        if (flat != nullptr)
+            flat->add_attribute(flat_current, att);
+        else
+            current->add_attribute(std::move(att));
+    }
+
+    /**
+     * @brief Builds the tree into a FlatTree instead of allocating nodes. Has to be called before the first token
+     * is consumed. The arena is then only used for subtrees built by managers, which get copied into the flat tree
+     * when appended, and the root returned by `get_root` stays empty.
+     * @param target The tree to build into, holding only its root. It has to outlive the builder.
+     */
+    void build_flat(FlatTree* target)
+    {
+        flat = target;
+        flat_current = 0;
     }
 
     /**
-     * @brief Returns the root of the tree.
-     * @return A unique_ptr to the root node.
+     * @brief Hands every top-level block over to `handler` as soon as it is finished, i.e. when the position in
+     * the tree returns to the root, instead of keeping it in the tree. The root returned by `get_root` then
+     * stays empty. Has to be called before the first token is consumed.
+     * @param handler The function receiving the blocks, in document order. The blocks are only valid during the call.
      */
-    std::unique_ptr<Node> get_root()
+    void set_block_handler(BlockHandler handler)
     {
-        return std::move(root);
+        block_handler = std::move(handler);
+    }
+
+    /**
+     * @brief Frees the blocks handed over so far by resetting the arena. Must only be called when no other
+     * nodes of the arena are in use, i.e. when TableManager holds no table.
+     */
+    void release_blocks()
+    {
+        if (!blocks_handed_over)
+            return;
+        arena->reset();
+        root = arena->create<Node>(ElementType::DOCSTART, nullptr);
+        current = root;
+        blocks_handed_over = false;
+    }
+
+    /**
+     * @brief Returns the root of the tree, which takes over the arena. With a block handler, hands over
+     * the blocks left open at the end of the document first.
+     * @return The root node, freeing the whole tree when destroyed.
+     */
+    TreeRoot get_root()
+    {
+        hand_over_blocks(true);
+        Node* taken = root;
+        root = nullptr;
+        return TreeRoot(taken, ArenaRelease{arena});
+    }
+
+    /**
+     * @brief Returns the arena the nodes are allocated in.
+     */
+    NodeArena* get_arena() const
+    {
+        return arena.get();
     }
 
     /**
      * @brief Prints the tree structure to the console.
      */
     void print_tree() const
+    {
+        print_tree(root);
+    }
+
+    /**
+     * @brief Prints the structure of a (sub)tree to the console.
+     * @param root The root of the printed tree.
+     */
+    static void print_tree(Node* root)
     {
         std::stack<std::pair<Node*, size_t>> node_stack;
-        node_stack.push(std::make_pair<Node*, size_t>(root.get(), 0));
+        node_stack.push(std::make_pair<Node*, size_t>(std::move(root), 0));
         while (!node_stack.empty())
         {
             std::pair<Node*, size_t> popped = node_stack.top();
@@ -149,14 +244,77 @@ public:
 
             for (auto it=popped.first->children.rbegin(); it != popped.first->children.rend(); ++it)
             {
-                node_stack.push(std::make_pair<Node*, size_t>((*it).get(), popped.second + 1));
+                node_stack.push(std::make_pair(*it, popped.second + 1));
             }
         }
     }
 private:
-    std::unique_ptr<Node> root = nullptr;
+    std::shared_ptr<NodeArena> arena;
+    Node* root = nullptr;
     Node* current = nullptr;
+    FlatTree* flat = nullptr;
+    NodeIndex flat_current = NO_NODE;
     Logger* logger;
+    BlockHandler block_handler;
+    bool blocks_handed_over = false;  // whether the arena holds blocks which were handed over
+
+    /**
+     * @brief Hands the children of the root over to the block handler if the root is the current node,
+     * so that no more nodes can be added to them.
+     * @param finished Whether the document has ended, leaving the last block unclosed or not.
+     */
+    void hand_over_blocks(bool finished = false)
+    {
+        if (!block_handler || (current != root && !finished) || root->children.empty())
+            return;
+        for (auto&& block : root->children)
+            block_handler(*block);
+        root->children.clear();
+        blocks_handed_over = true;
+    }
+
+    bool current_missing() const
+    {
+        return flat != nullptr ? flat_current == NO_NODE : current == nullptr;
+    }
+
+    /**
+     * @brief The counterpart of `consume_token` for building a FlatTree.
+     */
+    void consume_flat_token(Token token)
+    {
+        switch (token.type)
+        {
+        case TokenType::OpenToken:
+            if (token.element == ElementType::ImageType || token.element == ElementType::Hypertext)
+            {
+                ALLOCATION_SITE(TokenConstruction);
+                flat_current = flat->add_link(token.element, flat_current, std::string(token.text),
+                    std::string(token.link->alt), std::string(token.link->title));
+            }
+            else
+                flat_current = flat->add_node(token.element, flat_current);
+            break;
+        case TokenType::CloseToken:
+            if (token.element != flat->elements[flat_current]) {
+                LOG_ERROR(logger, "Current element ("+element_to_html_name[flat->elements[flat_current]]+") and \
+                    closing tag element ("+element_to_html_name[token.element]+") do not match. This is an error on our side.");
+                throw std::runtime_error("incorrectly parsed tree");
+            }
+            if (flat_current == 0)
+                LOG_WARNING(logger, "Moving 'current' above DOCTYPE element making it a nullptr.");
+            flat_current = flat->parents[flat_current];
+            break;
+        case TokenType::ContentToken:
+            flat->add_content(token.element, flat_current, token.to_text());
+            break;
+        case TokenType::EOF_Token:
+            break;
+        default:
+            LOG_ERROR(logger, "Unknown tokentype found during tree parsing.");
+            throw std::runtime_error("huh");
+        }
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,483 @@
+/**
+ * @file render_cache.hpp
+ * @brief A cache of rendered documents, keyed by a hash of their input.
+ */
+
+#ifndef _RENDER_CACHE_HPP
+#define _RENDER_CACHE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+#include <ostream>
+#include "node.hpp"
+#include "./parsing/input_source.hpp"
+#include "./building/output_sink.hpp"
+#include "./building/css_constructor.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief The version of the converter the cached output belongs to, part of every key. CMakeLists.txt sets it to
+ *        the project version and the `git describe` of the source, so that rebuilds of the same source share
+ *        a cache while builds of a different commit do not. Builds without it all use the fallback.
+ */
+#ifndef CONVERTER_VERSION
+#define CONVERTER_VERSION "unversioned"
+#endif
+
+/**
+ * @brief The size of the in-memory front of a RenderCache, in bytes of HTML (see RenderCache::RenderCache).
+ */
+#ifndef RENDER_CACHE_MEMORY_SIZE
+#define RENDER_CACHE_MEMORY_SIZE (64 << 20)
+#endif
+
+/**
+ * @struct CacheKey
+ * @brief A 128-bit hash of a document and of everything else its output depends on.
+ */
+struct CacheKey
+{
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    bool operator==(const CacheKey& other) const
+    {
+        return high == other.high && low == other.low;
+    }
+
+    /**
+     * @brief Returns the key as 32 hexadecimal digits.
+     */
+    std::string hex() const
+    {
+        static constexpr char DIGITS[] = "0123456789abcdef";
+        std::string text(32, '0');
+        for (size_t i = 0; i < 16; ++i)
+        {
+            text[15 - i] = DIGITS[(high >> (4 * i)) & 0xf];
+            text[31 - i] = DIGITS[(low >> (4 * i)) & 0xf];
+        }
+        return text;
+    }
+};
+
+/**
+ * @struct CachedRender
+ * @brief The output of a document: its HTML, and the attributes whose CSS classes it uses in the order of
+ * the classes in its CSS file, from which the CSS file is written again (see `write_css`).
+ */
+struct CachedRender
+{
+    std::string html;
+    std::vector<Attribute> attributes;
+
+    /**
+     * @brief Writes the CSS file of the document, the same as the one written when it was converted.
+     */
+    void write_css(OutputSink& styles_stream) const
+    {
+        CSS_Constructor css_builder(styles_stream);
+        css_builder.create_default_styling();
+        for (Attribute attr : attributes)
+            css_builder.add_css_attr_class(attr);
+    }
+};
+
+/**
+ * @struct CacheCounters
+ * @brief What a RenderCache has done so far.
+ */
+struct CacheCounters
+{
+    size_t memory_hits = 0;
+    size_t disk_hits = 0;
+    size_t misses = 0;
+    size_t stores = 0;
+    size_t evictions = 0;  // entries removed from the directory to stay under its size
+};
+
+/**
+ * @class RenderCache
+ * @brief Keeps the output of converted documents in a directory, so a document converted before is not
+ * parsed again, only its output copied.
+ *
+ * An entry is keyed by a 128-bit hash of the document's bytes, the converter version (see CONVERTER_VERSION)
+ * and the options its output depends on (the stylesheet the HTML links to). Entries are files named after
+ * their key, in subdirectories named after the first two digits. A file is written under a temporary name
+ * and renamed when complete, so processes and threads sharing a directory never see half an entry; two
+ * writers of the same entry write the same bytes. Reading an entry marks it as used (its modification time).
+ * Once the entries of the directory add up to more than its size, the least recently used ones are removed
+ * until they take 90% of it. The size is only checked against what this process knows, other processes
+ * sharing the directory are accounted for at the next eviction.
+ *
+ * A cache with a memory size (e.g. of a long-running server) also keeps the most recently used entries in
+ * memory, so that they are not even read from the directory. All methods can be called from several threads.
+ */
+class RenderCache
+{
+public:
+    /**
+     * @param directory Where to keep the entries. Created by `open` if missing.
+     * @param max_bytes The size of the entries the directory holds at most.
+     * @param memory_bytes The size of the HTML of the entries kept in memory as well, 0 to keep none.
+     */
+    RenderCache(const fs::path& directory, uint64_t max_bytes, size_t memory_bytes = 0)
+    : directory(directory),
+      max_bytes(max_bytes),
+      memory_bytes(memory_bytes) {}
+
+    RenderCache(const RenderCache&) = delete;
+    RenderCache& operator=(const RenderCache&) = delete;
+
+    /**
+     * @brief Creates the directory if needed and sums up the entries already in it.
+     * @return Whether the directory can be used.
+     */
+    bool open()
+    {
+        std::error_code error;
+        fs::create_directories(directory, error);
+        if (!fs::is_directory(directory, error))
+            return false;
+        disk_bytes = 0;
+        for (auto it = fs::recursive_directory_iterator(directory, error); !error && it != fs::recursive_directory_iterator(); it.increment(error))
+        {
+            std::error_code entry_error;
+            if (it->is_regular_file(entry_error) && it->path().extension() == ENTRY_EXTENSION)
+                disk_bytes += it->file_size(entry_error);
+        }
+        return !error;
+    }
+
+    /**
+     * @brief Computes the key of a document.
+     * @param input The bytes of the document.
+     * @param options Everything besides the document and the converter which the output depends on.
+     */
+    static CacheKey key(std::string_view input, std::string_view options)
+    {
+        std::string prefix = std::string(CONVERTER_VERSION) + '\0' + std::string(options);
+        CacheKey seed = hash(prefix, CacheKey{0x243f6a8885a308d3ull, 0x13198a2e03707344ull});
+        return hash(input, seed);
+    }
+
+    /**
+     * @brief Looks a document up, first in memory, then in the directory.
+     * @return The output of the document, or null if it is not in the cache.
+     */
+    std::shared_ptr<const CachedRender> lookup(const CacheKey& key)
+    {
+        if (memory_bytes != 0)
+        {
+            std::lock_guard<std::mutex> lock(memory_mutex);
+            auto it = memory_index.find(key);
+            if (it != memory_index.end())
+            {
+                recent.splice(recent.begin(), recent, it->second);
+                ++memory_hits;
+                return it->second->second;
+            }
+        }
+
+        std::shared_ptr<CachedRender> entry = read_entry(entry_path(key));
+        if (entry == nullptr)
+        {
+            ++misses;
+            return nullptr;
+        }
+        ++disk_hits;
+        remember(key, entry);
+        return entry;
+    }
+
+    /**
+     * @brief Keeps the output of a document. Failing to write the entry is not an error, the document
+     * is then only not cached. Neither is a document taking more than a quarter of the directory's size,
+     * which would push out everything else.
+     */
+    void store(const CacheKey& key, std::string_view html, const std::vector<Attribute>& attributes)
+    {
+        if (HEADER_SIZE + attributes.size() + html.size() > max_bytes / 4)
+            return;
+        fs::path path = entry_path(key);
+        std::error_code error;
+        fs::create_directories(path.parent_path(), error);
+        fs::path temporary = path;
+        temporary += ".tmp." + std::to_string(process_id()) + '.' + std::to_string(++temporary_counter);
+
+        char header[HEADER_SIZE];
+        std::memcpy(header, MAGIC, 4);
+        put(header + 4, FORMAT, 4);
+        put(header + 8, attributes.size(), 4);
+        put(header + 12, html.size(), 8);
+        std::string attribute_bytes;
+        for (Attribute attr : attributes)
+            attribute_bytes.push_back(static_cast<char>(attr));
+        try {
+            OutputSink file;
+            if (!file.open(temporary.string()))
+                return;
+            file << std::string_view(header, HEADER_SIZE) << attribute_bytes << html;
+            file.close();
+        } catch (std::runtime_error&) {
+            fs::remove(temporary, error);
+            return;
+        }
+        fs::rename(temporary, path, error);
+        if (error)
+        {
+            fs::remove(temporary, error);
+            return;
+        }
+        ++stores;
+
+        auto entry = std::make_shared<CachedRender>();
+        entry->html = html;
+        entry->attributes = attributes;
+        remember(key, entry);
+        if ((disk_bytes += HEADER_SIZE + attributes.size() + html.size()) > max_bytes)
+            evict();
+    }
+
+    CacheCounters get_counters() const
+    {
+        return CacheCounters{memory_hits.load(), disk_hits.load(), misses.load(), stores.load(), evictions.load()};
+    }
+
+    /**
+     * @brief Writes the counters as a JSON object.
+     */
+    void write_counters_json(std::ostream& out) const
+    {
+        CacheCounters counters = get_counters();
+        out << "{\"memory_hits\":" << counters.memory_hits << ",\"disk_hits\":" << counters.disk_hits
+            << ",\"misses\":" << counters.misses << ",\"stores\":" << counters.stores
+            << ",\"evictions\":" << counters.evictions << '}';
+    }
+
+private:
+    static constexpr char MAGIC[4] = {'M', 'D', 'R', 'C'};
+    static constexpr uint32_t FORMAT = 1;
+    static constexpr size_t HEADER_SIZE = 20;  // magic | u32 format | u32 attribute count | u64 html length
+    static constexpr const char* ENTRY_EXTENSION = ".entry";
+
+    using Recent = std::list<std::pair<CacheKey, std::shared_ptr<const CachedRender>>>;
+
+    struct KeyHash
+    {
+        size_t operator()(const CacheKey& key) const
+        {
+            return static_cast<size_t>(key.low);
+        }
+    };
+
+    fs::path directory;
+    uint64_t max_bytes;
+    size_t memory_bytes;
+    std::atomic<uint64_t> disk_bytes = 0;  // of the entries in the directory, as far as this process knows
+    std::atomic<size_t> temporary_counter = 0;
+    std::mutex eviction_mutex;
+
+    std::mutex memory_mutex;
+    Recent recent;  // the entries kept in memory, the most recently used first
+    std::unordered_map<CacheKey, Recent::iterator, KeyHash> memory_index;
+    size_t memory_used = 0;
+
+    std::atomic<size_t> memory_hits = 0;
+    std::atomic<size_t> disk_hits = 0;
+    std::atomic<size_t> misses = 0;
+    std::atomic<size_t> stores = 0;
+    std::atomic<size_t> evictions = 0;
+
+    /**
+     * @brief Hashes `bytes` into two 64-bit lanes, eight bytes at a time, starting from `seed`.
+     */
+    static CacheKey hash(std::string_view bytes, CacheKey seed)
+    {
+        constexpr uint64_t P1 = 0x9e3779b185ebca87ull;
+        constexpr uint64_t P2 = 0xc2b2ae3d27d4eb4full;
+        constexpr uint64_t P3 = 0x165667b19e3779f9ull;
+        constexpr uint64_t P4 = 0x85ebca77c2b2ae63ull;
+        uint64_t a = seed.high ^ (bytes.size() * P1);
+        uint64_t b = seed.low ^ (bytes.size() * P2);
+        const char* data = bytes.data();
+        size_t size = bytes.size();
+        for (; size >= 8; data += 8, size -= 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, data, 8);
+            a = rotate(a ^ (word * P1), 31) * P2;
+            b = rotate(b ^ (word * P3), 27) * P4;
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, data, size);
+        a = rotate(a ^ (tail * P1), 31) * P2;
+        b = rotate(b ^ (tail * P3), 27) * P4;
+        return CacheKey{mix(a ^ rotate(b, 17)), mix(b ^ rotate(a, 43))};
+    }
+
+    static uint64_t rotate(uint64_t value, int bits)
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    /**
+     * @brief The finalizer of MurmurHash3, making every bit of the result depend on every bit of `value`.
+     */
+    static uint64_t mix(uint64_t value)
+    {
+        value ^= value >> 33;
+        value *= 0xff51afd7ed558ccdull;
+        value ^= value >> 33;
+        value *= 0xc4ceb9fe1a85ec53ull;
+        value ^= value >> 33;
+        return value;
+    }
+
+    static void put(char* at, uint64_t value, size_t bytes)
+    {
+        for (size_t i = 0; i < bytes; ++i)
+            at[i] = static_cast<char>(value >> (8 * i));
+    }
+
+    static uint64_t get(const char* at, size_t bytes)
+    {
+        uint64_t value = 0;
+        for (size_t i = 0; i < bytes; ++i)
+            value |= static_cast<uint64_t>(static_cast<unsigned char>(at[i])) << (8 * i);
+        return value;
+    }
+
+    static long process_id()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        return static_cast<long>(::getpid());
+#else
+        return 0;
+#endif
+    }
+
+    fs::path entry_path(const CacheKey& key) const
+    {
+        std::string name = key.hex();
+        return directory / name.substr(0, 2) / (name + ENTRY_EXTENSION);
+    }
+
+    /**
+     * @brief Reads an entry and marks it as used.
+     * @return The entry, or null if it is missing or not a complete entry.
+     */
+    std::shared_ptr<CachedRender> read_entry(const fs::path& path)
+    {
+        InputSource file;
+        if (!file.open(path.string()))
+            return nullptr;
+        std::string_view bytes = file.view();
+        if (bytes.size() < HEADER_SIZE || std::memcmp(bytes.data(), MAGIC, 4) != 0 || get(bytes.data() + 4, 4) != FORMAT)
+            return nullptr;
+        uint64_t attribute_count = get(bytes.data() + 8, 4);
+        uint64_t html_length = get(bytes.data() + 12, 8);
+        if (attribute_count > bytes.size() - HEADER_SIZE || html_length != bytes.size() - HEADER_SIZE - attribute_count)
+            return nullptr;  // compared without adding up, so that huge lengths cannot wrap around
+
+        auto entry = std::make_shared<CachedRender>();
+        for (size_t i = 0; i < attribute_count; ++i)
+        {
+            unsigned char attr = static_cast<unsigned char>(bytes[HEADER_SIZE + i]);
+            if (attr >= attr_enum_to_name.size())
+                return nullptr;
+            entry->attributes.push_back(static_cast<Attribute>(attr));
+        }
+        entry->html = bytes.substr(HEADER_SIZE + attribute_count);
+        std::error_code error;
+        fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+        return entry;
+    }
+
+    /**
+     * @brief Keeps an entry in memory, if the cache has a memory size, dropping the least recently used ones.
+     */
+    void remember(const CacheKey& key, std::shared_ptr<const CachedRender> entry)
+    {
+        if (memory_bytes == 0 || entry->html.size() > memory_bytes / 4)
+            return;
+        std::lock_guard<std::mutex> lock(memory_mutex);
+        if (memory_index.find(key) != memory_index.end())
+            return;
+        recent.emplace_front(key, entry);
+        memory_index[key] = recent.begin();
+        memory_used += entry->html.size();
+        while (memory_used > memory_bytes)
+        {
+            memory_used -= recent.back().second->html.size();
+            memory_index.erase(recent.back().first);
+            recent.pop_back();
+        }
+    }
+
+    /**
+     * @brief Removes the least recently used entries of the directory until they take 90% of its size,
+     * and temporary files left behind for more than an hour.
+     */
+    void evict()
+    {
+        std::unique_lock<std::mutex> lock(eviction_mutex, std::try_to_lock);
+        if (!lock.owns_lock())
+            return;  // another thread is evicting already
+        struct Entry
+        {
+            fs::path path;
+            fs::file_time_type used;
+            uint64_t size;
+        };
+        std::vector<Entry> entries;
+        uint64_t total = 0;
+        auto stale = fs::file_time_type::clock::now() - std::chrono::hours(1);
+        std::error_code error;
+        for (auto it = fs::recursive_directory_iterator(directory, error); !error && it != fs::recursive_directory_iterator(); it.increment(error))
+        {
+            std::error_code entry_error;
+            if (!it->is_regular_file(entry_error))
+                continue;
+            fs::file_time_type used = it->last_write_time(entry_error);
+            if (it->path().extension() == ENTRY_EXTENSION)
+            {
+                entries.push_back(Entry{it->path(), used, it->file_size(entry_error)});
+                total += entries.back().size;
+            }
+            else if (it->path().filename().string().find(".tmp.") != std::string::npos && used < stale)
+                fs::remove(it->path(), entry_error);
+        }
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+        uint64_t target = max_bytes / 10 * 9;
+        for (const Entry& entry : entries)
+        {
+            if (total <= target)
+                break;
+            if (fs::remove(entry.path, error))
+            {
+                total -= entry.size;
+                ++evictions;
+            }
+        }
+        disk_bytes = total;
+    }
+};
+
+#endif
@@ -0,0 +1,371 @@
+/**
+ * @file conversion_server.hpp
+ * @brief A long-running process converting documents sent over a Unix domain socket.
+ */
+
+#ifndef _CONVERSION_SERVER_HPP
+#define _CONVERSION_SERVER_HPP
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CONVERSION_SERVER_POSIX 1
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "protocol.hpp"
+#include "../error_handler.hpp"
+#include "../parsing/markdown_parser.hpp"
+#include "../building/html_constructor.hpp"
+#include "../building/output_sink.hpp"
+#include "../render_cache.hpp"
+#include "../work_scheduler.hpp"
+
+/**
+ * @brief The largest document a ConversionServer accepts, in bytes.
+ */
+#ifndef SERVER_MAX_DOCUMENT_SIZE
+#define SERVER_MAX_DOCUMENT_SIZE (1ull << 30)
+#endif
+
+/**
+ * @brief How often, in milliseconds, waiting threads of a ConversionServer check whether it is stopping.
+ */
+#ifndef SERVER_POLL_INTERVAL
+#define SERVER_POLL_INTERVAL 200
+#endif
+
+/**
+ * @class ConversionServer
+ * @brief Converts documents sent over a Unix domain socket (see protocol.hpp) until it is stopped, so that
+ * small documents do not pay for starting a process, building the global tables and opening files.
+ *
+ * The calling thread accepts connections and hands them to a fixed number of workers. A worker serves
+ * one connection at a time, request after request, until the client closes it. Every worker keeps its
+ * request buffer, its HTML_Builder and the OutputSinks collecting the HTML and CSS in memory across
+ * requests, so once they have grown to the size of the documents served, a conversion allocates little.
+ * Documents are rendered straight from the parser's tokens (see HTML_Renderer), with the same output
+ * as the command line converter. With a RenderCache (see `set_cache`), a document converted before is
+ * answered from the cache, its CSS written again from the attributes kept with it.
+ */
+class ConversionServer
+{
+public:
+    /**
+     * @param logger A pointer to the overarching Logger instance, shared by the workers.
+     * @param workers The number of worker threads, i.e. of connections served at once. At most `max_worker_threads()`.
+     */
+    ConversionServer(Logger* logger, size_t workers)
+    : logger(logger),
+      worker_count(std::clamp<size_t>(workers, 1, max_worker_threads())) {}
+
+    ConversionServer(const ConversionServer&) = delete;
+    ConversionServer& operator=(const ConversionServer&) = delete;
+
+    /**
+     * @brief Closes the socket and removes it from the file system.
+     */
+    ~ConversionServer()
+    {
+        if (listen_fd < 0)
+            return;
+        ::close(listen_fd);
+        ::unlink(socket_path.c_str());
+    }
+
+    /**
+     * @brief Creates the socket at `path`, replacing a stale socket left there, and starts listening.
+     * @return Whether the socket could be created. Anything at `path` other than a socket is left alone.
+     */
+    bool listen(const std::string& path)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path))
+            return false;
+        std::copy(path.begin(), path.end(), address.sun_path);
+
+        struct stat info;
+        if (::lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+            ::unlink(path.c_str());
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return false;
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        listen_fd = fd;
+        socket_path = path;
+        return true;
+    }
+
+    /**
+     * @brief Answers from `cache` the documents it holds, and stores those converted. Off by default.
+     */
+    void set_cache(RenderCache* cache)
+    {
+        this->cache = cache;
+    }
+
+    /**
+     * @brief Serves connections until `stop` is called. Connections being served are finished first,
+     * the requests already received are still answered.
+     * @return The number of requests answered.
+     */
+    size_t run()
+    {
+        std::vector<std::thread> threads;
+        std::vector<size_t> served(worker_count, 0);
+        for (size_t i = 0; i < worker_count; ++i)
+            threads.emplace_back([this, i, &served] { served[i] = work(); });
+
+        while (!stopping.load(std::memory_order_relaxed))
+        {
+            if (!wait_readable(listen_fd))
+                continue;
+            int fd = ::accept(listen_fd, nullptr, nullptr);
+            if (fd < 0)
+                continue;
+            LOG_INFO(logger, "Accepted a connection.");
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                connections.push_back(fd);
+            }
+            queue_ready.notify_one();
+        }
+
+        queue_ready.notify_all();
+        for (std::thread& thread : threads)
+            thread.join();
+        for (int fd : connections)
+            ::close(fd);
+        connections.clear();
+        size_t total = 0;
+        for (size_t count : served)
+            total += count;
+        return total;
+    }
+
+    /**
+     * @brief Makes `run` return soon. Can be called from a signal handler.
+     */
+    void stop()
+    {
+        stopping.store(true, std::memory_order_relaxed);
+    }
+
+private:
+    /**
+     * @struct Worker
+     * @brief What a worker keeps from one request to the next.
+     */
+    struct Worker
+    {
+        Worker(Logger* logger)
+        : builder(logger) {}
+
+        std::string request;  // the markdown of the current request
+        std::string stylesheet_name;
+        OutputSink html;
+        OutputSink css;
+        HTML_Builder builder;
+        std::string error;  // the message of a failed conversion
+        std::shared_ptr<const CachedRender> cached;  // the cache entry answering the current request, if any
+    };
+
+    static_assert(std::atomic<bool>::is_always_lock_free, "stop has to be async-signal-safe");
+
+    Logger* logger;
+    size_t worker_count;
+    int listen_fd = -1;
+    std::string socket_path;
+    RenderCache* cache = nullptr;
+    std::atomic<bool> stopping = false;
+    std::mutex queue_mutex;
+    std::condition_variable queue_ready;
+    std::deque<int> connections;  // accepted, waiting for a worker
+
+    /**
+     * @brief Waits until `fd` can be read or the poll interval has passed.
+     * @return Whether it can be read.
+     */
+    bool wait_readable(int fd)
+    {
+        pollfd request{fd, POLLIN, 0};
+        return ::poll(&request, 1, SERVER_POLL_INTERVAL) > 0;
+    }
+
+    /**
+     * @brief The loop of a worker thread: serves connections one after the other until stopping.
+     * @return The number of requests answered.
+     */
+    size_t work()
+    {
+        Worker worker(logger);
+        size_t served = 0;
+        while (true)
+        {
+            int fd;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                while (connections.empty() && !stopping.load(std::memory_order_relaxed))
+                    queue_ready.wait_for(lock, std::chrono::milliseconds(SERVER_POLL_INTERVAL));
+                if (connections.empty())
+                    return served;
+                fd = connections.front();
+                connections.pop_front();
+            }
+            served += serve_connection(worker, fd);
+            ::close(fd);
+        }
+    }
+
+    /**
+     * @brief Answers the requests of a connection until the client closes it or the server stops.
+     * @return The number of requests answered.
+     */
+    size_t serve_connection(Worker& worker, int fd)
+    {
+        size_t served = 0;
+        while (true)
+        {
+            while (!wait_readable(fd))
+            {
+                if (stopping.load(std::memory_order_relaxed))
+                    return served;
+            }
+            char header_bytes[protocol::REQUEST_HEADER_SIZE];
+            protocol::RequestHeader header;
+            if (!protocol::read_exact(fd, header_bytes, sizeof(header_bytes)))
+                return served;  // closed by the client
+            if (!protocol::decode(header_bytes, header) || header.name_length > protocol::MAX_STYLESHEET_NAME
+                || header.markdown_length > SERVER_MAX_DOCUMENT_SIZE)
+            {
+                LOG_WARNING(logger, "Received a malformed or too large request, closing the connection.");
+                respond_error(fd, protocol::BadRequest, "malformed or too large request");
+                return served;
+            }
+            worker.stylesheet_name.resize(header.name_length);
+            worker.request.resize(header.markdown_length);
+            if (!protocol::read_exact(fd, worker.stylesheet_name.data(), header.name_length)
+                || !protocol::read_exact(fd, worker.request.data(), header.markdown_length))
+                return served;
+
+            bool want_css = (header.flags & protocol::WantCss) != 0;
+            std::string_view html;
+            bool sent = answer(worker, want_css, html) ? respond(fd, html, worker.css, want_css)
+                : respond_error(fd, protocol::ConversionFailed, worker.error);
+            if (!sent)
+                return served;
+            ++served;
+        }
+    }
+
+    /**
+     * @brief Converts the request of `worker` into its HTML (and CSS) sink.
+     * @return Whether the conversion succeeded, otherwise `worker.error` tells why.
+     */
+    bool convert(Worker& worker, bool want_css)
+    {
+        worker.html.open_memory();
+        if (want_css)
+        {
+            worker.css.open_memory();
+            worker.builder.set_css_builder(worker.css);
+        }
+        else
+            worker.builder.set_css_builder();
+        const std::string& stylesheet = worker.stylesheet_name.empty() ? DEFAULT_STYLESHEET : worker.stylesheet_name;
+        try {
+            Md_Parser parser(std::string_view(worker.request), logger);
+            parser.set_sink(&worker.builder.begin_render(worker.html, stylesheet));
+            parser.parse_document();
+            worker.builder.end_stream();
+        } catch (std::runtime_error& err) {
+            worker.error = err.what();
+            LOG_ERROR(logger, "Converting a request failed: " + worker.error);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Produces the output of the request of `worker`: from the cache if it holds the document,
+     * otherwise converting it (and storing it in the cache, if any).
+     * @param html Set to the HTML, valid until the next request of `worker`.
+     * @return Whether the document could be converted, with its CSS in `worker.css` if wanted,
+     * otherwise `worker.error` tells why.
+     */
+    bool answer(Worker& worker, bool want_css, std::string_view& html)
+    {
+        CacheKey key;
+        worker.cached = nullptr;
+        if (cache != nullptr)
+        {
+            const std::string& stylesheet = worker.stylesheet_name.empty() ? DEFAULT_STYLESHEET : worker.stylesheet_name;
+            key = RenderCache::key(worker.request, stylesheet);
+            worker.cached = cache->lookup(key);
+        }
+        if (worker.cached != nullptr)
+        {
+            if (want_css)
+            {
+                worker.css.open_memory();
+                worker.cached->write_css(worker.css);
+            }
+            html = worker.cached->html;
+            return true;
+        }
+        if (!convert(worker, want_css))
+            return false;
+        html = worker.html.contents();
+        if (cache != nullptr)
+            cache->store(key, html, worker.builder.get_attributes_in_order());
+        return true;
+    }
+
+    bool respond(int fd, std::string_view html, const OutputSink& css_sink, bool with_css)
+    {
+        std::string_view css = with_css ? css_sink.contents() : std::string_view();
+        protocol::ResponseHeader header{protocol::Ok, html.size(), css.size()};
+        char header_bytes[protocol::RESPONSE_HEADER_SIZE];
+        protocol::encode(header, header_bytes);
+        struct iovec parts[3] = {
+            {header_bytes, sizeof(header_bytes)},
+            {const_cast<char*>(html.data()), html.size()},
+            {const_cast<char*>(css.data()), css.size()},
+        };
+        return protocol::write_all(fd, parts, 3);
+    }
+
+    bool respond_error(int fd, protocol::Status status, const std::string& message)
+    {
+        protocol::ResponseHeader header{status, message.size(), 0};
+        char header_bytes[protocol::RESPONSE_HEADER_SIZE];
+        protocol::encode(header, header_bytes);
+        struct iovec parts[2] = {
+            {header_bytes, sizeof(header_bytes)},
+            {const_cast<char*>(message.data()), message.size()},
+        };
+        return protocol::write_all(fd, parts, 2);
+    }
+
+    inline static const std::string DEFAULT_STYLESHEET = "styles.css";
+};
+
+#endif
+
+#endif
@@ -0,0 +1,190 @@
+/**
+ * @file markdown_client.cpp
+ * @brief Converts a document by sending it to a running conversion server (see ConversionServer).
+ *
+ * Usage: markdown_client [options]
+ *
+ *   --socket *path*      the socket the server listens on (markdown_converter --serve *path*)
+ *   -i *path*            the document to convert
+ *   -o *path*            where to write the HTML (output.html by default)
+ *   -s *path*            where to write the CSS, also the stylesheet the HTML links to (styles.css by default)
+ *   --no-css             do not ask for the CSS nor write it
+ *   --repeat *n*         send the document `n` times over the same connection and print the fastest and
+ *                        the mean time from sending a request to having its response (1 by default)
+ *
+ * The output is the same as that of markdown_converter -i *path* -o ... -s ... The exit code is 1 when
+ * the server could not be reached or failed to convert the document, and 2 on usage errors.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "protocol.hpp"
+#include "../parsing/input_source.hpp"
+#include "../building/output_sink.hpp"
+
+static int usage()
+{
+    std::cerr << "Usage: markdown_client --socket path -i path [-o path] [-s path] [--no-css] [--repeat n]" << std::endl;
+    return 2;
+}
+
+static int connect_to(const std::string& path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        return -1;
+    std::copy(path.begin(), path.end(), address.sun_path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Sends a request and receives its response into `html` and `css`.
+ * @return Whether a response has been received.
+ */
+static bool convert(int fd, std::string_view markdown, const std::string& stylesheet, bool want_css,
+    protocol::ResponseHeader& response, std::string& html, std::string& css)
+{
+    protocol::RequestHeader request{want_css ? protocol::WantCss : 0u, static_cast<uint32_t>(stylesheet.size()), markdown.size()};
+    char request_bytes[protocol::REQUEST_HEADER_SIZE];
+    protocol::encode(request, request_bytes);
+    struct iovec parts[3] = {
+        {request_bytes, sizeof(request_bytes)},
+        {const_cast<char*>(stylesheet.data()), stylesheet.size()},
+        {const_cast<char*>(markdown.data()), markdown.size()},
+    };
+    if (!protocol::write_all(fd, parts, 3))
+        return false;
+
+    char response_bytes[protocol::RESPONSE_HEADER_SIZE];
+    if (!protocol::read_exact(fd, response_bytes, sizeof(response_bytes)) || !protocol::decode(response_bytes, response))
+        return false;
+    html.resize(response.html_length);
+    css.resize(response.css_length);
+    return protocol::read_exact(fd, html.data(), html.size()) && protocol::read_exact(fd, css.data(), css.size());
+}
+
+int main(int argc, char** argv)
+{
+    std::string socket_path;
+    std::string input_path;
+    std::string output_path = "output.html";
+    std::string styles_path = "styles.css";
+    bool want_css = true;
+    size_t repeat = 1;
+
+    std::vector<std::string> args(argv + 1, argv + argc);
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        const std::string& name = args[i];
+        if (name == "--no-css")
+        {
+            want_css = false;
+            continue;
+        }
+        if (i + 1 >= args.size())
+            return usage();
+        const std::string& value = args[++i];
+        try {
+            if (name == "--socket")
+                socket_path = value;
+            else if (name == "-i")
+                input_path = value;
+            else if (name == "-o")
+                output_path = value;
+            else if (name == "-s")
+                styles_path = value;
+            else if (name == "--repeat")
+                repeat = std::max<size_t>(1, std::stoull(value));
+            else
+                return usage();
+        } catch (std::exception&) {
+            return usage();
+        }
+    }
+    if (socket_path.empty() || input_path.empty())
+        return usage();
+
+    InputSource input;
+    if (!input.open(input_path))
+    {
+        std::cerr << "Unable to open " << input_path << std::endl;
+        return 1;
+    }
+    int fd = connect_to(socket_path);
+    if (fd < 0)
+    {
+        std::cerr << "Unable to connect to " << socket_path << std::endl;
+        return 1;
+    }
+
+    protocol::ResponseHeader response;
+    std::string html;
+    std::string css;
+    std::vector<double> seconds;
+    for (size_t i = 0; i < repeat; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (!convert(fd, input.view(), styles_path, want_css, response, html, css))
+        {
+            std::cerr << "The connection to the server broke off" << std::endl;
+            ::close(fd);
+            return 1;
+        }
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+        seconds.push_back(took.count());
+        if (response.status != protocol::Ok)
+            break;
+    }
+    ::close(fd);
+    if (response.status != protocol::Ok)
+    {
+        std::cerr << "The server could not convert the document: " << html << std::endl;
+        return 1;
+    }
+
+    try {
+        OutputSink output;
+        if (!output.open(output_path))
+            throw std::runtime_error("unable to open " + output_path);
+        output << html;
+        output.close();
+        if (want_css)
+        {
+            OutputSink styles;
+            if (!styles.open(styles_path))
+                throw std::runtime_error("unable to open " + styles_path);
+            styles << css;
+            styles.close();
+        }
+    } catch (std::runtime_error& err) {
+        std::cerr << "Error writing the output: " << err.what() << std::endl;
+        return 1;
+    }
+
+    if (repeat > 1)
+    {
+        double total = 0;
+        for (double took : seconds)
+            total += took;
+        std::cout << std::fixed << std::setprecision(3) << repeat << " requests: fastest "
+            << *std::min_element(seconds.begin(), seconds.end()) * 1000 << " ms, mean "
+            << total / seconds.size() * 1000 << " ms" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file protocol.hpp
+ * @brief The framing of the requests and responses of the conversion server, shared with its client.
+ */
+
+#ifndef _PROTOCOL_HPP
+#define _PROTOCOL_HPP
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/uio.h>
+
+/**
+ * The protocol runs over a stream socket (a Unix domain socket). A connection carries any number of
+ * requests, each answered by one response before the next request is read. All integers are unsigned
+ * and little-endian.
+ *
+ * Request:  "MDRQ" | u32 flags | u32 stylesheet name length | u64 markdown length | stylesheet name | markdown
+ * Response: "MDRS" | u32 status | u64 html length | u64 css length | html | css
+ *
+ * The stylesheet name is what the HTML links to ("styles.css" if empty). With the WantCss flag the
+ * response holds the CSS file of the document, otherwise its CSS is empty. A status other than Ok comes
+ * with an error message in place of the HTML. After a BadRequest the server closes the connection.
+ */
+namespace protocol
+{
+    constexpr char REQUEST_MAGIC[4] = {'M', 'D', 'R', 'Q'};
+    constexpr char RESPONSE_MAGIC[4] = {'M', 'D', 'R', 'S'};
+    constexpr size_t REQUEST_HEADER_SIZE = 20;
+    constexpr size_t RESPONSE_HEADER_SIZE = 24;
+    constexpr size_t MAX_STYLESHEET_NAME = 4096;
+
+    enum Flags : uint32_t
+    {
+        WantCss = 1,
+    };
+
+    enum Status : uint32_t
+    {
+        Ok = 0,
+        ConversionFailed = 1,  // the document could not be converted
+        BadRequest = 2,  // the request is malformed or too large
+    };
+
+    struct RequestHeader
+    {
+        uint32_t flags = 0;
+        uint32_t name_length = 0;
+        uint64_t markdown_length = 0;
+    };
+
+    struct ResponseHeader
+    {
+        uint32_t status = Ok;
+        uint64_t html_length = 0;
+        uint64_t css_length = 0;
+    };
+
+    inline void put(char* at, uint64_t value, size_t bytes)
+    {
+        for (size_t i = 0; i < bytes; ++i)
+            at[i] = static_cast<char>(value >> (8 * i));
+    }
+
+    inline uint64_t get(const char* at, size_t bytes)
+    {
+        uint64_t value = 0;
+        for (size_t i = 0; i < bytes; ++i)
+            value |= static_cast<uint64_t>(static_cast<unsigned char>(at[i])) << (8 * i);
+        return value;
+    }
+
+    inline void encode(const RequestHeader& header, char (&out)[REQUEST_HEADER_SIZE])
+    {
+        std::copy(REQUEST_MAGIC, REQUEST_MAGIC + 4, out);
+        put(out + 4, header.flags, 4);
+        put(out + 8, header.name_length, 4);
+        put(out + 12, header.markdown_length, 8);
+    }
+
+    /**
+     * @return Whether the header starts with the magic of a request.
+     */
+    inline bool decode(const char (&in)[REQUEST_HEADER_SIZE], RequestHeader& header)
+    {
+        if (!std::equal(REQUEST_MAGIC, REQUEST_MAGIC + 4, in))
+            return false;
+        header.flags = static_cast<uint32_t>(get(in + 4, 4));
+        header.name_length = static_cast<uint32_t>(get(in + 8, 4));
+        header.markdown_length = get(in + 12, 8);
+        return true;
+    }
+
+    inline void encode(const ResponseHeader& header, char (&out)[RESPONSE_HEADER_SIZE])
+    {
+        std::copy(RESPONSE_MAGIC, RESPONSE_MAGIC + 4, out);
+        put(out + 4, header.status, 4);
+        put(out + 8, header.html_length, 8);
+        put(out + 16, header.css_length, 8);
+    }
+
+    /**
+     * @return Whether the header starts with the magic of a response.
+     */
+    inline bool decode(const char (&in)[RESPONSE_HEADER_SIZE], ResponseHeader& header)
+    {
+        if (!std::equal(RESPONSE_MAGIC, RESPONSE_MAGIC + 4, in))
+            return false;
+        header.status = static_cast<uint32_t>(get(in + 4, 4));
+        header.html_length = get(in + 8, 8);
+        header.css_length = get(in + 16, 8);
+        return true;
+    }
+
+    /**
+     * @brief Reads exactly `size` bytes.
+     * @return Whether they could be read, false on an error or the end of the stream.
+     */
+    inline bool read_exact(int fd, char* data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t count = ::read(fd, data, size);
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                return false;
+            data += count;
+            size -= count;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Writes all of the parts, in order, with as few system calls as possible.
+     * @return Whether everything could be written.
+     */
+    inline bool write_all(int fd, struct iovec* parts, int count)
+    {
+        while (count > 0)
+        {
+            ssize_t written = ::writev(fd, parts, count);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written < 0)
+                return false;
+            // skip what has been written, a write may be partial
+            while (count > 0 && static_cast<size_t>(written) >= parts->iov_len)
+            {
+                written -= parts->iov_len;
+                ++parts;
+                --count;
+            }
+            if (count > 0)
+            {
+                parts->iov_base = static_cast<char*>(parts->iov_base) + written;
+                parts->iov_len -= written;
+            }
+        }
+        return true;
+    }
+}
+
+#endif
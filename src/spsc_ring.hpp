@@ -0,0 +1,106 @@
+/**
+ * @file spsc_ring.hpp
+ * @brief A bounded lock-free queue between exactly one producer thread and one consumer thread.
+ */
+
+#ifndef _SPSC_RING_HPP
+#define _SPSC_RING_HPP
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+
+/**
+ * @class SpscRing
+ * @brief A ring of a fixed number of values, pushed by one thread and popped by another in the same order.
+ *
+ * The producer only writes `head` and the consumer only writes `tail`, each on a cache line of its own,
+ * so neither ever takes a lock. Each side keeps a copy of the other side's index and only reloads it once
+ * the copy says the ring is full (or empty). A push into a full ring waits for the consumer, which is what
+ * bounds the memory of a pipeline built from rings.
+ *
+ * @tparam T The type of the values, moved in and out.
+ */
+template <typename T>
+class SpscRing
+{
+public:
+    /**
+     * @param capacity The number of values the ring holds, rounded up to a power of two.
+     */
+    SpscRing(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        mask = size - 1;
+        slots = std::make_unique<T[]>(size);
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    /**
+     * @brief Pushes a value unless the ring is full. Producer only.
+     * @return Whether the value has been pushed.
+     */
+    bool try_push(T& value)
+    {
+        size_t pos = producer.index.load(std::memory_order_relaxed);
+        if (pos - producer.cached_other > mask)
+        {
+            producer.cached_other = consumer.index.load(std::memory_order_acquire);
+            if (pos - producer.cached_other > mask)
+                return false;
+        }
+        slots[pos & mask] = std::move(value);
+        producer.index.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Pushes a value, waiting for room while the ring is full. Producer only.
+     */
+    void push(T value)
+    {
+        while (!try_push(value))
+            std::this_thread::yield();
+    }
+
+    /**
+     * @brief Pops the oldest value unless the ring is empty. Consumer only.
+     * @return Whether a value has been popped into `value`.
+     */
+    bool try_pop(T& value)
+    {
+        size_t pos = consumer.index.load(std::memory_order_relaxed);
+        if (pos == consumer.cached_other)
+        {
+            consumer.cached_other = producer.index.load(std::memory_order_acquire);
+            if (pos == consumer.cached_other)
+                return false;
+        }
+        value = std::move(slots[pos & mask]);
+        consumer.index.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    /**
+     * @struct Side
+     * @brief The index written by one side, and its copy of the other side's index.
+     */
+    struct alignas(64) Side
+    {
+        std::atomic<size_t> index = 0;
+        size_t cached_other = 0;
+    };
+
+    Side producer;  // head: the next position to push to
+    Side consumer;  // tail: the next position to pop from
+    std::unique_ptr<T[]> slots;
+    size_t mask;
+};
+
+#endif
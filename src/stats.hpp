@@ -0,0 +1,292 @@
+/**
+ * @file stats.hpp
+ * @brief Timing and counting what a conversion does (see --stats).
+ */
+
+#ifndef _STATS_HPP
+#define _STATS_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <ctime>
+#include <ostream>
+#include <sstream>
+#include <iomanip>
+#include <array>
+#include "token.hpp"
+#include "node.hpp"
+#include "alloc_accounting.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define STATS_POSIX 1
+#include <sys/resource.h>
+#endif
+
+/**
+ * @enum Phase
+ * @brief The phases of a conversion. Tables and TreeBuilding happen within Parse, Styles within Render.
+ */
+enum Phase
+{
+    Idle,
+    Read,
+    Parse,  // the state machine itself
+    Tables,
+    TreeBuilding,
+    Render,  // HTML_Visitor
+    Styles,
+    PhaseCount
+};
+
+constexpr std::array<const char*, PhaseCount> phase_names = {
+    "idle", "read", "parse", "tables", "tree_building", "render", "styles"
+};
+
+#ifdef ALLOCATION_ACCOUNTING
+static_assert(PhaseCount <= AllocationProfile::PHASES, "AllocationProfile counts too few phases");
+#endif
+
+/**
+ * @class Stats
+ * @brief Collects the time spent in each phase of converting a document, the bytes read and written,
+ *        and the numbers of tokens and nodes.
+ *
+ * The time of a phase excludes the phases nested in it, so the times add up. Wall time is taken at every
+ * change of phase. CPU time (of the calling thread) is only taken when moving between Read, Parse and Render
+ * with their nested phases, because reading the CPU clock costs a system call and the nested phases change
+ * with every token.
+ *
+ * A Stats object is not thread-safe: it belongs to a single document parsed on a single thread. Collecting
+ * is off wherever a null pointer is passed instead (see PhaseTimer).
+ *
+ * @see PhaseTimer
+ */
+class Stats
+{
+public:
+    size_t bytes_in = 0;
+    size_t html_bytes_out = 0;
+    size_t css_bytes_out = 0;
+    bool tokens_counted = false;  // whether the tokens have been counted, they are not when no parser ran
+
+    /**
+     * @brief Starts timing `phase`, stopping the current one.
+     * @return The phase which was current so far.
+     */
+    Phase enter(Phase phase)
+    {
+        Phase previous = current;
+        auto now = std::chrono::steady_clock::now();
+        if (current != Idle)
+            wall[current] += std::chrono::duration<double>(now - since).count();
+        since = now;
+        if (group(phase) != group(current))
+        {
+            double cpu = cpu_seconds();
+            if (current != Idle)
+                cpu_time[group(current)] += cpu - cpu_since;
+            cpu_since = cpu;
+        }
+        current = phase;
+#ifdef ALLOCATION_ACCOUNTING
+        AllocationProfile::set_phase(phase);
+#endif
+        return previous;
+    }
+
+    void count_token(TokenType type)
+    {
+        ++tokens[type];
+    }
+
+    /**
+     * @brief Counts the nodes of a (sub)tree, by their ElementType. Callers count the top-level blocks,
+     *        so the DOCSTART root is not counted the same way with and without streaming.
+     */
+    void count_nodes(const Node& root)
+    {
+        std::vector<const Node*> stack = {&root};
+        while (!stack.empty())
+        {
+            const Node* node = stack.back();
+            stack.pop_back();
+            ++nodes[node->element];
+            for (const Node* child : node->children)
+                stack.push_back(child);
+        }
+    }
+
+    /**
+     * @brief Counts the nodes of a FlatTree or a FlatTreeView, by their ElementType. The DOCSTART root is
+     *        not counted, as with `count_nodes` of the top-level blocks.
+     */
+    template<typename Tree>
+    void count_flat_nodes(const Tree& tree)
+    {
+        for (size_t i = 1; i < tree.size(); ++i)
+            ++nodes[tree.elements[i]];
+    }
+
+    /**
+     * @brief Adds the times and counts of another Stats object, e.g. of a part of the document parsed elsewhere.
+     */
+    void merge(const Stats& other)
+    {
+        for (size_t i = 0; i < PhaseCount; ++i)
+        {
+            wall[i] += other.wall[i];
+            cpu_time[i] += other.cpu_time[i];
+        }
+        for (size_t i = 0; i < TOKEN_TYPES; ++i)
+            tokens[i] += other.tokens[i];
+        for (size_t i = 0; i < ELEMENT_TYPES; ++i)
+            nodes[i] += other.nodes[i];
+    }
+
+    /**
+     * @brief Writes the collected values as a JSON object.
+     * @param input The path of the document.
+     * @param with_peak_rss Whether to include the peak resident set size of the process.
+     */
+    void write_json(std::ostream& out, const std::string& input, bool with_peak_rss) const
+    {
+        out << "{\"input\":" << json_string(input)
+            << ",\"bytes_in\":" << bytes_in
+            << ",\"bytes_out\":{\"html\":" << html_bytes_out << ",\"css\":" << css_bytes_out << '}'
+            << ",\"phases\":{"
+            << "\"read\":{\"wall_seconds\":" << wall[Read] << ",\"cpu_seconds\":" << cpu_time[Read] << '}'
+            << ",\"parse\":{\"wall_seconds\":" << wall[Parse] + wall[Tables] + wall[TreeBuilding]
+            << ",\"cpu_seconds\":" << cpu_time[Parse]
+            << ",\"state_machine\":" << wall[Parse] << ",\"tables\":" << wall[Tables]
+            << ",\"tree_building\":" << wall[TreeBuilding] << '}'
+            << ",\"render\":{\"wall_seconds\":" << wall[Render] + wall[Styles]
+            << ",\"cpu_seconds\":" << cpu_time[Render]
+            << ",\"html\":" << wall[Render] << ",\"css\":" << wall[Styles] << "}}";
+
+        out << ",\"tokens\":";
+        if (tokens_counted)
+            out << "{\"open\":" << tokens[OpenToken] << ",\"close\":" << tokens[CloseToken]
+                << ",\"content\":" << tokens[ContentToken] << ",\"eof\":" << tokens[EOF_Token] << '}';
+        else
+            out << "null";
+
+        out << ",\"nodes\":{";
+        for (size_t i = 0; i < ELEMENT_TYPES; ++i)
+            out << (i == 0 ? "" : ",") << '"' << element_names[i] << "\":" << nodes[i];
+        out << '}';
+
+        if (with_peak_rss)
+            out << ",\"peak_rss_bytes\":" << peak_rss_bytes();
+        out << '}';
+    }
+
+    /**
+     * @brief Returns the peak resident set size of the process in bytes, 0 if unknown.
+     */
+    static size_t peak_rss_bytes()
+    {
+#ifdef STATS_POSIX
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return 0;
+#ifdef __APPLE__
+        return static_cast<size_t>(usage.ru_maxrss);
+#else
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+        return 0;
+#endif
+    }
+
+    static std::string json_string(std::string_view text)
+    {
+        std::ostringstream out;
+        out << '"';
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                out << '\\' << c;
+            else if (static_cast<unsigned char>(c) < 0x20)
+                out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+            else
+                out << c;
+        }
+        out << '"';
+        return out.str();
+    }
+
+private:
+    static constexpr size_t TOKEN_TYPES = EOF_Token + 1;
+    static constexpr size_t ELEMENT_TYPES = EOF_Reached + 1;
+    static constexpr const char* element_names[ELEMENT_TYPES] = {
+        "DOCSTART", "Content", "Header_1", "Header_2", "Header_3", "Header_4", "Header_5", "Header_6", "Paragraph",
+        "Codeblock", "Horizontalline", "Hypertext", "ImageType", "Span", "List_Ordered", "List_Unordered",
+        "List_Element", "Table", "Table_Head", "Table_Row", "Table_Cell", "EOF_Reached"
+    };
+
+    Phase current = Idle;
+    std::chrono::steady_clock::time_point since;
+    double cpu_since = 0;
+    double wall[PhaseCount] = {};
+    double cpu_time[PhaseCount] = {};  // only kept for Read, Parse and Render, including their nested phases
+    size_t tokens[TOKEN_TYPES] = {};
+    size_t nodes[ELEMENT_TYPES] = {};
+
+    /**
+     * @brief Returns the phase whose CPU time includes the given one.
+     */
+    static Phase group(Phase phase)
+    {
+        switch (phase)
+        {
+        case Tables:
+        case TreeBuilding:
+            return Parse;
+        case Styles:
+            return Render;
+        default:
+            return phase;
+        }
+    }
+
+    static double cpu_seconds()
+    {
+#ifdef STATS_POSIX
+        struct timespec time;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return time.tv_sec + time.tv_nsec / 1e9;
+#else
+        return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+#endif
+    }
+};
+
+/**
+ * @class PhaseTimer
+ * @brief Times a phase for as long as it lives, then goes back to the enclosing phase. Does nothing without Stats.
+ */
+class PhaseTimer
+{
+public:
+    PhaseTimer(Stats* stats, Phase phase)
+    : stats(stats),
+      previous(stats != nullptr ? stats->enter(phase) : Idle) {}
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    ~PhaseTimer()
+    {
+        if (stats != nullptr)
+            stats->enter(previous);
+    }
+
+private:
+    Stats* stats;
+    Phase previous;
+};
+
+#endif
@@ -2,17 +2,20 @@
 #define _TOKEN_HPP
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <cstdint>
+#include "alloc_accounting.hpp"
 
 
-enum TokenType {
+enum TokenType : uint8_t {
     OpenToken,
     CloseToken,
     ContentToken,
     EOF_Token
 };
 
-enum ElementType {
+enum ElementType : uint8_t {
     DOCSTART,
     Content,
     Header_1,
@@ -37,32 +40,128 @@ enum ElementType {
     EOF_Reached,
 };
 
+/**
+ * @class Text
+ * @brief The textual payload of a token or a content node.
+ *
+ * Most text is a verbatim run of the input document, in which case `Text` only records
+ * a span (pointer and length) into the input buffer and nothing is copied. Text which does not
+ * appear verbatim in the input (e.g. an unclosed `**` re-emitted in front of its content) owns
+ * its characters instead. Spans are only valid as long as the input buffer is.
+ */
+class Text
+{
+public:
+    Text() = default;
+
+    /**
+     * @brief Constructs a Text owning its characters.
+     * @param owned The characters to own.
+     */
+    Text(std::string&& owned)
+    : owned(std::move(owned)),
+      is_span(false) {}
+
+    /**
+     * @brief Constructs a Text viewing a span of the input buffer (or of other storage outliving it).
+     * @param span The viewed characters.
+     */
+    static Text span_of(std::string_view span)
+    {
+        Text text;
+        text.span = span;
+        text.is_span = true;
+        return text;
+    }
+
+    /**
+     * @brief Returns the characters, regardless of whether they are owned or viewed.
+     */
+    std::string_view view() const
+    {
+        return is_span ? span : std::string_view(owned);
+    }
+
+    /**
+     * @brief Returns an owned copy of the characters.
+     */
+    std::string str() const
+    {
+        return std::string(view());
+    }
+
+    bool empty() const
+    {
+        return view().empty();
+    }
+
+    /**
+     * @brief Returns whether the characters are viewed rather than owned (see `span_of`).
+     */
+    bool is_view() const
+    {
+        return is_span;
+    }
+
+private:
+    std::string owned;
+    std::string_view span;
+    bool is_span = false;
+};
+
+/**
+ * @struct LinkText
+ * @brief The alt (or displayed) text and the title of an image or a hyperlink token.
+ */
+struct LinkText
+{
+    std::string_view alt;
+    std::string_view title;
+};
+
 /**
  * @struct Token
- * @brief A struct representing a token in the parsing process. It contains the type, element, content, alt text, and title of the token.
+ * @brief A token in the parsing process: its type, its element and views of its payload.
+ *
+ * A token owns nothing, so it is passed by value and emitting one never allocates. `text` is the content
+ * of a content token or the url of an image or a hyperlink, whose alt text and title `link` points to.
+ * Unless `verbatim` is set (the text is a span of the input document), the payload belongs to the parser
+ * and is only valid until the token has been consumed, so consumers copy what they keep (see `to_text`).
  */
 struct Token {
     TokenType type;
     ElementType element;
-    std::string content;
-    std::string alt;
-    std::string title;
+    bool verbatim;
+    std::string_view text;
+    const LinkText* link;
+
     /**
      * @brief Constructs a Token object.
      * @param type The type of the token.
      * @param el The element type of the token.
-     * @param text The content of the token.
-     * @param alt The alt text of the token (default is an empty string).
-     * @param title The title of the token (default is an empty string).
+     * @param text The content of the token, or the url of an image or a hyperlink.
+     * @param verbatim Whether `text` is a span of the input document.
+     * @param link The alt text and title of an image or a hyperlink.
      */
-    Token(TokenType type, ElementType el, const std::string& text, const std::string& alt = "", const std::string& title = "")
-    : type(type), 
-      element(el), 
-      content(text),
-      alt(alt),
-      title(title) {}
+    Token(TokenType type, ElementType el, std::string_view text = {}, bool verbatim = false, const LinkText* link = nullptr)
+    : type(type),
+      element(el),
+      verbatim(verbatim),
+      text(text),
+      link(link) {}
+
+    /**
+     * @brief Returns the text for a node to keep: a span of the input if verbatim, an owned copy otherwise.
+     */
+    Text to_text() const
+    {
+        ALLOCATION_SITE(TokenConstruction);
+        return verbatim ? Text::span_of(text) : Text(std::string(text));
+    }
 };
 
+static_assert(sizeof(Token) <= 32, "a Token should stay small enough to be passed in registers or a half cache line");
+
 
 
 std::unordered_map<ElementType, std::string> element_to_html_name = 
@@ -0,0 +1,273 @@
+/**
+ * @file token_pipeline.hpp
+ * @brief Converting a single document on three threads: reading, parsing and rendering.
+ */
+
+#ifndef _TOKEN_PIPELINE_HPP
+#define _TOKEN_PIPELINE_HPP
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <stdexcept>
+#include <cstdint>
+#include "token.hpp"
+#include "node.hpp"
+#include "spsc_ring.hpp"
+#include "wait_point.hpp"
+#include "parsing_tree/token_sink.hpp"
+#include "parsing/markdown_parser.hpp"
+#include "parsing/streamed_input.hpp"
+
+/**
+ * @brief The number of events (tokens and attributes) the parsing thread of a TokenPipeline collects
+ *        before handing them over to the rendering thread at once.
+ */
+#ifndef TOKEN_PIPELINE_BATCH_SIZE
+#define TOKEN_PIPELINE_BATCH_SIZE 2048
+#endif
+
+/**
+ * @brief The number of batches of a TokenPipeline. Once all of them are waiting to be rendered, parsing
+ *        waits as well, so they bound the memory used between the two threads.
+ */
+#ifndef TOKEN_PIPELINE_BATCHES
+#define TOKEN_PIPELINE_BATCHES 16
+#endif
+
+/**
+ * @class TokenPipeline
+ * @brief Parses a document on the calling thread and hands the tokens over to a `TokenSink` running on
+ * a thread of its own, e.g. an HTML_Renderer writing the output, while a StreamedInput is read on a third one.
+ *
+ * The cut is at Token_Emitter: the parsing thread copies each token into a compact event of a batch,
+ * with the payloads which are not verbatim views of the input (and those of links) copied into the
+ * batch's text. Full batches go to the rendering thread through one SpscRing and come back empty through
+ * another, so after the first round nothing is allocated. There are TOKEN_PIPELINE_BATCHES batches in
+ * all: when the sink falls behind, the parser waits for an empty batch (and when the parser falls behind
+ * the reader, it waits for input). Each side waits at a WaitPoint, so it blocks once the other one is slow.
+ *
+ * The sink receives the same calls in the same order as it would from the parser directly. An exception
+ * thrown by the sink stops the parser and is rethrown by `run`.
+ */
+class TokenPipeline
+{
+public:
+    /**
+     * @param target The sink to run on the rendering thread. It has to outlive the pipeline.
+     */
+    TokenPipeline(TokenSink& target)
+    : target(target),
+      batches(std::make_unique<Batch[]>(TOKEN_PIPELINE_BATCHES)),
+      full(TOKEN_PIPELINE_BATCHES),
+      empty(TOKEN_PIPELINE_BATCHES),
+      producer(*this) {}
+
+    /**
+     * @brief Parses the whole document, which has been read once `run` returns.
+     * @param parser A parser of the document which has not parsed yet, e.g. of a StreamedInput.
+     * @param input The document parsed by `parser`. Verbatim payloads are passed on as views into it.
+     * @throws std::runtime_error If parsing or the sink failed.
+     */
+    void run(Md_Parser& parser, std::string_view input)
+    {
+        this->input = input;
+        for (size_t i = 0; i < TOKEN_PIPELINE_BATCHES; ++i)
+        {
+            batches[i].events.reserve(TOKEN_PIPELINE_BATCH_SIZE);
+            Batch* batch = &batches[i];
+            empty.push(batch);
+        }
+        std::thread consumer([this] { consume(); });
+        try {
+            parser.set_sink(&producer);
+            parser.parse_document();
+        } catch (...) {
+            produced.store(true, std::memory_order_release);
+            batch_full.notify();
+            consumer.join();
+            if (sink_error != nullptr)
+                std::rethrow_exception(sink_error);
+            throw;
+        }
+        consumer.join();
+        if (sink_error != nullptr)
+            std::rethrow_exception(sink_error);
+    }
+
+private:
+    /**
+     * @struct Event
+     * @brief A token or an attribute, without any pointers, so it can cross to the other thread.
+     */
+    struct Event
+    {
+        bool is_attribute;
+        TokenType type;
+        ElementType element;
+        bool verbatim;  // the text is in the input, not in the batch's text
+        bool has_link;  // the alt text and the title follow the text in the batch's text
+        Attribute attribute;
+        uint32_t text_length;
+        uint32_t alt_length;
+        uint32_t title_length;
+        size_t offset;  // of the text, in the input if verbatim, in the batch's text otherwise
+    };
+
+    struct Batch
+    {
+        std::vector<Event> events;
+        std::string text;
+    };
+
+    /**
+     * @class Producer
+     * @brief The sink of the parser, filling batches on the parsing thread.
+     */
+    class Producer : public TokenSink
+    {
+    public:
+        Producer(TokenPipeline& pipeline)
+        : pipeline(pipeline) {}
+
+        void consume_token(Token token) override
+        {
+            Batch& batch = current();
+            Event event{false, token.type, token.element, token.verbatim && token.link == nullptr,
+                token.link != nullptr, Attribute{}, static_cast<uint32_t>(token.text.size()), 0, 0, 0};
+            if (event.verbatim)
+                event.offset = token.text.data() - pipeline.input.data();
+            else
+            {
+                event.offset = batch.text.size();
+                batch.text.append(token.text);
+            }
+            if (token.link != nullptr)
+            {
+                event.alt_length = static_cast<uint32_t>(token.link->alt.size());
+                event.title_length = static_cast<uint32_t>(token.link->title.size());
+                batch.text.append(token.link->alt);
+                batch.text.append(token.link->title);
+            }
+            add(event);
+        }
+
+        void add_attribute(Attribute attribute) override
+        {
+            current();
+            add(Event{true, TokenType::OpenToken, ElementType::DOCSTART, false, false, attribute, 0, 0, 0, 0});
+        }
+
+        void end_document() override
+        {
+            if (batch != nullptr)
+                pipeline.full.push(batch);
+            batch = nullptr;
+            pipeline.complete = true;
+            pipeline.produced.store(true, std::memory_order_release);
+            pipeline.batch_full.notify();
+        }
+
+    private:
+        TokenPipeline& pipeline;
+        Batch* batch = nullptr;  // the batch being filled
+
+        Batch& current()
+        {
+            if (batch != nullptr)
+                return *batch;
+            // backpressure: every batch is waiting for the sink
+            pipeline.batch_empty.wait([this] { return pipeline.empty.try_pop(batch); });
+            if (pipeline.sink_failed.load(std::memory_order_acquire))
+                throw std::runtime_error("the sink of the pipeline failed");
+            return *batch;
+        }
+
+        void add(const Event& event)
+        {
+            batch->events.push_back(event);
+            if (batch->events.size() == TOKEN_PIPELINE_BATCH_SIZE)
+            {
+                pipeline.full.push(batch);
+                pipeline.batch_full.notify();
+                batch = nullptr;
+            }
+        }
+    };
+
+    TokenSink& target;
+    std::string_view input;
+    std::unique_ptr<Batch[]> batches;
+    SpscRing<Batch*> full;  // from the parsing to the rendering thread
+    SpscRing<Batch*> empty;  // back to the parsing thread
+    WaitPoint batch_full;  // the rendering thread waits for a full batch or the end of parsing
+    WaitPoint batch_empty;  // the parsing thread waits for an empty batch
+    Producer producer;
+    std::atomic<bool> produced = false;  // whether the parser has pushed its last batch
+    bool complete = false;  // whether the parser reached the end of the document, written before `produced`
+    std::atomic<bool> sink_failed = false;
+    std::exception_ptr sink_error;  // read by the parsing thread once the rendering thread has been joined
+
+    /**
+     * @brief The loop of the rendering thread: passes the events of every full batch on to the sink until
+     * the parser is done. After an exception of the sink the batches are only given back.
+     */
+    void consume()
+    {
+        while (true)
+        {
+            Batch* batch = nullptr;
+            batch_full.wait([this, &batch] { return full.try_pop(batch) || produced.load(std::memory_order_acquire); });
+            if (batch == nullptr && !full.try_pop(batch))
+                break;
+            if (sink_error == nullptr)
+            {
+                try {
+                    replay(*batch);
+                } catch (...) {
+                    sink_error = std::current_exception();
+                    sink_failed.store(true, std::memory_order_release);
+                }
+            }
+            batch->events.clear();
+            batch->text.clear();
+            empty.push(batch);
+            batch_empty.notify();
+        }
+        if (complete && sink_error == nullptr)
+        {
+            try {
+                target.end_document();
+            } catch (...) {
+                sink_error = std::current_exception();
+            }
+        }
+    }
+
+    void replay(const Batch& batch)
+    {
+        for (const Event& event : batch.events)
+        {
+            if (event.is_attribute)
+            {
+                target.add_attribute(event.attribute);
+                continue;
+            }
+            const char* text = (event.verbatim ? input.data() : batch.text.data()) + event.offset;
+            Token token(event.type, event.element, std::string_view(text, event.text_length), event.verbatim);
+            LinkText link;
+            if (event.has_link)
+            {
+                link.alt = std::string_view(text + event.text_length, event.alt_length);
+                link.title = std::string_view(text + event.text_length + event.alt_length, event.title_length);
+                token.link = &link;
+            }
+            target.consume_token(token);
+        }
+    }
+};
+
+#endif
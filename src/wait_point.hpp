@@ -0,0 +1,76 @@
+/**
+ * @file wait_point.hpp
+ * @brief Waiting for another thread, spinning for a short while before blocking.
+ */
+
+#ifndef _WAIT_POINT_HPP
+#define _WAIT_POINT_HPP
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+/**
+ * @brief The number of times a WaitPoint checks its condition, yielding in between, before it blocks.
+ */
+#ifndef WAIT_POINT_SPINS
+#define WAIT_POINT_SPINS 64
+#endif
+
+/**
+ * @class WaitPoint
+ * @brief Lets a thread wait until a condition made true by another thread holds, e.g. a lock-free queue
+ * not being empty any more.
+ *
+ * Waiting first checks the condition WAIT_POINT_SPINS times, yielding in between, which is enough while both
+ * threads keep up with each other. After that the thread blocks on a condition variable, so a thread waiting
+ * for a slow disk or a slow consumer does not keep a core busy. The other thread calls `notify` after every
+ * change which can make the condition true; it only takes the lock when a thread is actually blocked.
+ */
+class WaitPoint
+{
+public:
+    /**
+     * @brief Returns once `ready()` returns true. `ready` may have effects, e.g. pop from a queue,
+     *        and is called until it returns true.
+     */
+    template <typename Condition>
+    void wait(Condition ready)
+    {
+        for (size_t i = 0; i < WAIT_POINT_SPINS; ++i)
+        {
+            if (ready())
+                return;
+            std::this_thread::yield();
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        blocked.store(true, std::memory_order_relaxed);
+        // pairs with the fence in `notify`: either the waiting thread sees the change or the notifying one sees it blocked
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!ready())
+            woken.wait(lock);
+        blocked.store(false, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Wakes the waiting thread if it is blocked. Has to be called after the change it is told about.
+     */
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!blocked.load(std::memory_order_relaxed))
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+        }
+        woken.notify_all();
+    }
+
+private:
+    std::atomic<bool> blocked = false;
+    std::mutex mutex;
+    std::condition_variable woken;
+};
+
+#endif
@@ -0,0 +1,222 @@
+/**
+ * @file work_scheduler.hpp
+ * @brief A work-stealing pool of worker threads.
+ */
+
+#ifndef _WORK_SCHEDULER_HPP
+#define _WORK_SCHEDULER_HPP
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <optional>
+#include <functional>
+#include <algorithm>
+
+/**
+ * @brief The number of threads per core a pool of workers is limited to.
+ */
+#ifndef MAX_THREADS_PER_CORE
+#define MAX_THREADS_PER_CORE 4
+#endif
+
+/**
+ * @brief Returns the largest number of worker threads worth starting on this machine.
+ */
+inline size_t max_worker_threads()
+{
+    return std::max(1u, std::thread::hardware_concurrency()) * static_cast<size_t>(MAX_THREADS_PER_CORE);
+}
+
+/**
+ * @struct WorkerStats
+ * @brief What a single worker of a WorkScheduler has done.
+ */
+struct WorkerStats
+{
+    double busy_seconds = 0;  // the time spent running tasks
+    size_t tasks = 0;
+    size_t stolen = 0;  // the tasks taken from the queues of other workers
+};
+
+/**
+ * @class WorkScheduler
+ * @brief Runs tasks on a fixed number of workers, each with its own double-ended queue.
+ *
+ * A worker takes its next task from the front of its own queue. Once it is empty, the worker steals
+ * from the back of the other workers' queues, so the tasks seeded first (the largest ones, see `seed`)
+ * are run first by their owners while idle workers pick up what is left over at the end. A running task
+ * can add tasks to the front of its worker's queue with `spawn`, e.g. to split itself into smaller pieces
+ * which other workers can then steal.
+ *
+ * The threads are started as there are tasks for them: `run` starts one per seeded task, `spawn` one more
+ * for each task added, up to `worker_count()` threads. A worker without a task to take waits until a task
+ * is spawned or all of them have finished.
+ *
+ * Tasks have to handle their own errors, an exception thrown by a task terminates the program.
+ */
+class WorkScheduler
+{
+public:
+    using Task = std::function<void(size_t worker)>;  // takes the index of the worker running it
+
+    /**
+     * @param workers The number of workers, including the thread calling `run`. At most `max_worker_threads()`.
+     */
+    WorkScheduler(size_t workers)
+    : queues(std::clamp<size_t>(workers, 1, max_worker_threads())),
+      stats(queues.size()) {}
+
+    size_t worker_count() const
+    {
+        return queues.size();
+    }
+
+    /**
+     * @brief Deals tasks out to the workers' queues in turn. Has to be called before `run`.
+     * @param tasks The tasks, the ones to start with first.
+     */
+    void seed(std::vector<Task> tasks)
+    {
+        pending += tasks.size();
+        size_t owners = std::clamp<size_t>(tasks.size(), 1, queues.size());  // the workers `run` starts
+        for (size_t i = 0; i < tasks.size(); ++i)
+            queues[i % owners].tasks.push_back(std::move(tasks[i]));
+    }
+
+    /**
+     * @brief Adds a task to the front of a worker's queue, to be run next by that worker unless stolen.
+     * Can only be called by a running task.
+     * @param worker The worker running the calling task.
+     * @param task The task to add.
+     */
+    void spawn(size_t worker, Task task)
+    {
+        ++pending;
+        {
+            std::lock_guard<std::mutex> lock(queues[worker].mutex);
+            queues[worker].tasks.push_front(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            ++spawned;
+        }
+        task_ready.notify_one();
+        start_workers(1);
+    }
+
+    /**
+     * @brief Runs the tasks on `worker_count()` threads (the calling one being worker 0)
+     * and returns once all of them, including those spawned on the way, have finished.
+     */
+    void run()
+    {
+        start_workers(pending - std::min<size_t>(pending, 1));  // the calling thread takes the first task
+        work(0);
+        std::lock_guard<std::mutex> lock(threads_mutex);  // nothing is spawned any more
+        for (auto&& thread : threads)
+            thread.join();
+        threads.clear();
+    }
+
+    /**
+     * @brief Returns what each worker has done, valid after `run`.
+     */
+    const std::vector<WorkerStats>& get_stats() const
+    {
+        return stats;
+    }
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    std::vector<WorkerQueue> queues;
+    std::vector<WorkerStats> stats;  // each entry is only written by its own worker
+    std::atomic<size_t> pending = 0;  // the tasks which have not finished yet
+    std::mutex threads_mutex;
+    std::vector<std::thread> threads;  // the workers started so far, but the calling thread
+    std::mutex idle_mutex;
+    std::condition_variable task_ready;  // notified when a task is spawned or the last one finishes
+    size_t spawned = 0;  // guarded by idle_mutex
+
+    /**
+     * @brief Starts up to `count` more worker threads, as long as fewer than `worker_count()` are running.
+     */
+    void start_workers(size_t count)
+    {
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        for (; count > 0 && threads.size() + 1 < queues.size(); --count)
+        {
+            size_t i = threads.size() + 1;
+            threads.emplace_back([this, i] { work(i); });
+        }
+    }
+
+    void work(size_t worker)
+    {
+        while (pending > 0)
+        {
+            size_t spawned_before;
+            {
+                std::lock_guard<std::mutex> lock(idle_mutex);
+                spawned_before = spawned;
+            }
+            bool stolen = false;
+            std::optional<Task> task = pop(worker);
+            for (size_t i = 1; !task.has_value() && i < queues.size(); ++i)
+            {
+                task = steal((worker + i) % queues.size());
+                stolen = task.has_value();
+            }
+            if (!task.has_value())
+            {
+                // everything left is already running, wait for it to finish or to spawn more tasks
+                std::unique_lock<std::mutex> lock(idle_mutex);
+                task_ready.wait(lock, [this, spawned_before] { return spawned != spawned_before || pending == 0; });
+                continue;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            (*task)(worker);
+            std::chrono::duration<double> busy = std::chrono::steady_clock::now() - start;
+            stats[worker].busy_seconds += busy.count();
+            ++stats[worker].tasks;
+            if (stolen)
+                ++stats[worker].stolen;
+            if (--pending == 0)
+            {
+                std::lock_guard<std::mutex> lock(idle_mutex);
+                task_ready.notify_all();
+            }
+        }
+    }
+
+    std::optional<Task> pop(size_t worker)
+    {
+        std::lock_guard<std::mutex> lock(queues[worker].mutex);
+        if (queues[worker].tasks.empty())
+            return std::nullopt;
+        Task task = std::move(queues[worker].tasks.front());
+        queues[worker].tasks.pop_front();
+        return task;
+    }
+
+    std::optional<Task> steal(size_t victim)
+    {
+        std::lock_guard<std::mutex> lock(queues[victim].mutex);
+        if (queues[victim].tasks.empty())
+            return std::nullopt;
+        Task task = std::move(queues[victim].tasks.back());
+        queues[victim].tasks.pop_back();
+        return task;
+    }
+};
+
+#endif